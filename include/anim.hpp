@@ -0,0 +1,64 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Adafruit_GFX.h>
+
+/**
+ * Time-based transitions.
+ *
+ * Crossfades and pulses composite RGB565 frames drawn offscreen onto the
+ * display, through blend tables built once per frame for its alpha. Brightness
+ * changes ramp the panel's own brightness instead, which keeps full color
+ * depth. Everything is driven by the time a frame is shown, so a late frame
+ * doesn't stretch an animation.
+ */
+namespace anim {
+
+/**
+ * Frame rate while anything is animating.
+ */
+constexpr uint16_t FPS = 50;
+
+constexpr uint32_t CROSSFADE_MS = 500;
+constexpr uint32_t RAMP_MS = 400;
+
+/**
+ * Whether anything is animating, i.e. frames are needed at `FPS`.
+ */
+bool active() noexcept;
+
+/**
+ * Canvas to draw the outgoing frame into, before `start_crossfade()`.
+ */
+Adafruit_GFX* outgoing() noexcept;
+
+/**
+ * Fade from the outgoing frame to whatever is drawn from `at_us` on.
+ */
+void start_crossfade(int64_t at_us) noexcept;
+
+/**
+ * Pulse white over the display for a while, starting with the next frame.
+ */
+void start_pulse(uint32_t duration_ms) noexcept;
+
+/**
+ * Brightness to show a frame at, ramping towards `target`.
+ */
+uint8_t brightness(uint8_t target, int64_t at_us) noexcept;
+
+/**
+ * Where to draw the frame shown at `at_us`: an offscreen canvas while
+ * compositing, `display` otherwise.
+ */
+Adafruit_GFX* target(Adafruit_GFX* display, int64_t at_us) noexcept;
+
+/**
+ * Composite the frame onto `display`, if it was drawn offscreen.
+ */
+void finish(Adafruit_GFX* display) noexcept;
+
+void print_status() noexcept;
+void reset_stats() noexcept;
+
+} // namespace anim
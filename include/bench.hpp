@@ -0,0 +1,27 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ezTime.h>
+
+#include <ESP32-HUB75-MatrixPanel-I2S-DMA.h>
+
+/**
+ * On-device benchmarks of the render paths, run from the serial console.
+ *
+ *  - `bench draw <clock|pomodoro> [iterations] [full]`
+ *  - `bench text <text...>`
+ *  - `bench shade`
+ *  - `bench config`
+ *
+ * Results are printed as min/avg/p99/max microseconds.
+ */
+namespace bench {
+
+/**
+ * Register the `bench` console command.
+ *
+ * @param color Points to the current text color.
+ */
+void begin(MatrixPanel_I2S_DMA* display, Timezone* local_tz, const uint16_t* color) noexcept;
+
+} // namespace bench
@@ -3,10 +3,16 @@
 #include <Arduino.h>
 #include <ezTime.h>
 
-#include <ESP32-HUB75-MatrixPanel-I2S-DMA.h>
+#include <Adafruit_GFX.h>
 
 namespace matrix_clock {
 
-void draw(MatrixPanel_I2S_DMA* display, Timezone* local_tz);
+/**
+ * Draw the clock face as of `now` (UTC).
+ *
+ * Instantiated in clock.cpp for `panel_geometry`.
+ */
+template <typename G>
+void draw(Adafruit_GFX* gfx, Timezone* local_tz, time_t now, uint16_t color);
 
-}
+} // namespace matrix_clock
@@ -27,6 +27,12 @@ void print_status() noexcept;
  */
 namespace mqtt {
 
+/**
+ * Longest message we can receive, messages split across several packets are
+ * reassembled up to this length.
+ */
+constexpr size_t MAX_MESSAGE_LEN = 2048;
+
 typedef void (*on_connect_cb)(bool);
 typedef void (*on_message_cb)(
     String*, uint8_t*, size_t, AsyncMqttClientMessageProperties
@@ -50,10 +56,29 @@ void set_message_cb(on_message_cb cb);
 void connect() noexcept;
 
 /**
- * Print stats about the connection to MQTT.
+ * Print stats about the connection to MQTT, including traffic over the last
+ * minute.
  */
 void print_status() noexcept;
 
+/**
+ * Roll over traffic stats and publish them every minute. Call from the main loop.
+ */
+void poll() noexcept;
+
+struct stats_t {
+    bool connected;
+    uint32_t connects;
+    uint32_t disconnects;
+    uint32_t messages;    // whole messages received
+    uint32_t round_trips; // acks sent and received
+};
+
+/**
+ * Connection and traffic counters since boot.
+ */
+stats_t stats() noexcept;
+
 /**
  * Subscribe to a MQTT topic.
  *
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <Arduino.h>
+
+/**
+ * Line-based command shell on the serial port.
+ *
+ * Commands are registered by name and get whitespace separated arguments, with
+ * `argv[0]` being the command name. `help` lists everything registered.
+ */
+namespace console {
+
+typedef void (*command_fn)(int argc, char** argv);
+
+constexpr uint8_t MAX_COMMANDS = 40;
+constexpr uint8_t MAX_ARGS = 8;
+constexpr size_t LINE_LEN = 96;
+
+/**
+ * Register a command.
+ *
+ * @param usage Arguments and a short description, shown by `help`.
+ *
+ * @returns false if there is no room left. That's a bug, raise `MAX_COMMANDS`,
+ *   so it fails an assert too.
+ */
+bool add(const char* name, const char* usage, command_fn fn) noexcept;
+
+/**
+ * Read whatever serial input is available and run completed lines. Never
+ * blocks.
+ */
+void poll() noexcept;
+
+} // namespace console
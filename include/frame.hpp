@@ -0,0 +1,147 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <ESP32-HUB75-MatrixPanel-I2S-DMA.h>
+
+/**
+ * Bookkeeping for the buffers we draw into.
+ *
+ * Incremental renderers only touch what changed since they last drew into the
+ * current back buffer. With double buffering that is the frame before last, so
+ * they keep one record per buffer, indexed by `back_buffer()`.
+ *
+ * Without MAT_DOUBLE_BUFF, frames are drawn into a shadow canvas instead of the
+ * panel. Flipping copies over only the pixels that differ from what the panel
+ * shows, as horizontal spans in one burst, so clearing and redrawing never
+ * shows up half done. The library doesn't expose the DMA scan position to time
+ * the burst against, so spans go out by row group instead: the two rows the
+ * panel scans out together are updated back to back.
+ */
+namespace frame {
+
+constexpr uint8_t BUFFER_COUNT = 2;
+
+/**
+ * Set up the buffers.
+ *
+ * @param dma_bytes What the display allocated for its DMA buffers.
+ */
+void begin(size_t dma_bytes) noexcept;
+
+/**
+ * Where to draw the frame: the shadow canvas when single buffered, `display`
+ * itself otherwise.
+ */
+Adafruit_GFX* target(MatrixPanel_I2S_DMA* display) noexcept;
+
+/**
+ * Note that something drew straight onto the display, so the next flip has to
+ * copy over everything.
+ */
+void forget_panel() noexcept;
+
+/**
+ * Index of the buffer currently being drawn into.
+ */
+uint8_t back_buffer() noexcept;
+
+/**
+ * Whether the contents of the back buffer are unknown and must be redrawn from
+ * scratch.
+ */
+bool needs_full_redraw() noexcept;
+
+/**
+ * Mark every buffer as needing a full redraw, e.g. after a mode change.
+ */
+void invalidate() noexcept;
+
+/**
+ * Show what was drawn into the back buffer.
+ */
+void flip(MatrixPanel_I2S_DMA* display) noexcept;
+
+/**
+ * Set the brightness the frame being drawn should be shown at.
+ *
+ * Changing the brightness touches every buffer, so it is held back until
+ * `apply_brightness()` runs after the frame is shown.
+ */
+void set_brightness(uint8_t brightness) noexcept;
+
+/**
+ * Apply the brightness of the frame being shown, if it differs from the panel's.
+ */
+void apply_brightness(MatrixPanel_I2S_DMA* display) noexcept;
+
+/**
+ * Flip from a timer at `at_us` (in `esp_timer_get_time()` time), so the frame
+ * shows up on time no matter what the loop is doing. Flips right away if
+ * `at_us` already passed.
+ *
+ * Nothing may be drawn while `flip_pending()`.
+ */
+void schedule_flip(MatrixPanel_I2S_DMA* display, int64_t at_us) noexcept;
+
+/**
+ * Whether a scheduled flip hasn't happened yet.
+ */
+bool flip_pending() noexcept;
+
+struct flip_stats_t {
+    uint32_t flips;    // scheduled flips done
+    uint32_t late;     // frames that were ready after their deadline
+    int64_t skew_us;   // total time between deadline and flip
+    int64_t max_skew_us;
+    uint32_t dropped;  // frames skipped to catch up
+    uint32_t rendered; // frames drawn
+    int64_t render_us; // total time spent drawing them
+};
+
+flip_stats_t flip_stats() noexcept;
+
+/**
+ * Account for `count` frames that were skipped because drawing fell behind.
+ */
+void record_dropped(uint32_t count) noexcept;
+
+struct push_stats_t {
+    uint32_t pushes; // flips that copied the shadow canvas over
+    uint32_t spans;
+    uint32_t pixels;
+    int64_t push_us; // total time from the first pixel written to the last
+    int64_t max_push_us;
+};
+
+/**
+ * Single buffered partial updates, all zero when double buffered.
+ */
+push_stats_t push_stats() noexcept;
+
+/**
+ * What the display allocated for its DMA buffers.
+ */
+size_t dma_bytes() noexcept;
+
+/**
+ * Account for time spent drawing a frame.
+ */
+void record_render(uint32_t render_us) noexcept;
+
+struct load_t {
+    uint32_t frames;
+    uint32_t render_us; // spent drawing
+    uint32_t window_us; // out of
+};
+
+/**
+ * Frames drawn and time spent drawing them over the last full second. The rest
+ * of the time the loop has nothing to draw.
+ */
+load_t load() noexcept;
+
+void reset_stats() noexcept;
+void print_status() noexcept;
+
+} // namespace frame
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "config.h"
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Compile-time description of an LED matrix chain.
+ *
+ * Renderers are templated on this, so centering offsets, row strides and buffer
+ * sizes are folded into constants instead of being recomputed every frame.
+ */
+template <uint16_t PanelWidth, uint16_t PanelHeight, uint8_t Chain>
+struct display_geometry {
+    static_assert(PanelWidth > 0 && PanelHeight > 0, "Panel must not be empty");
+    static_assert(Chain > 0, "Chain must have at least one panel");
+
+    static constexpr uint16_t panel_width = PanelWidth;
+    static constexpr uint16_t panel_height = PanelHeight;
+    static constexpr uint8_t chain = Chain;
+
+    // Panels are chained horizontally
+    static constexpr uint16_t width = PanelWidth * Chain;
+    static constexpr uint16_t height = PanelHeight;
+
+    static constexpr size_t pixels = static_cast<size_t>(width) * height;
+    static constexpr size_t row_stride = width * sizeof(uint16_t); // RGB565
+    static constexpr size_t frame_bytes = pixels * sizeof(uint16_t);
+
+    /**
+     * Cursor x that centers something `w` pixels wide.
+     */
+    static constexpr int16_t
+    centered_x(uint16_t w) noexcept
+    {
+        return (static_cast<int16_t>(width) - static_cast<int16_t>(w)) / 2;
+    }
+
+    /**
+     * Cursor y that centers something `h` pixels tall.
+     */
+    static constexpr int16_t
+    centered_y(uint16_t h) noexcept
+    {
+        return (static_cast<int16_t>(height) - static_cast<int16_t>(h)) / 2;
+    }
+};
+
+/**
+ * Geometry of the matrix described in config.h.
+ *
+ * This is the only place the MAT_RES_X/MAT_RES_Y/MAT_CHAIN macros should be read,
+ * everything else goes through `panel_geometry`.
+ */
+using panel_geometry = display_geometry<MAT_RES_X, MAT_RES_Y, MAT_CHAIN>;
+
+/* Glyph metrics of the built-in 5x7 GFX font */
+constexpr uint8_t GFX_CHAR_W = 6; // includes 1px spacing
+constexpr uint8_t GFX_CHAR_H = 8; // includes 1px spacing
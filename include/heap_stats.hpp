@@ -0,0 +1,87 @@
+#pragma once
+
+#include <Arduino.h>
+
+/**
+ * Heap usage broken down by subsystem.
+ *
+ * In builds with HEAP_STATS (`pio run -e esp32dev-heap`), malloc/calloc/realloc/
+ * free are wrapped at link time. Live blocks are remembered in a fixed-size table
+ * along with the subsystem that allocated them, which is decided by the
+ * allocating task or an enclosing `heap_stats::scope`. Every allocation takes a
+ * critical section, so other builds only sample the free heap.
+ */
+namespace heap_stats {
+
+#ifdef HEAP_STATS
+constexpr bool ENABLED = true;
+#else
+constexpr bool ENABLED = false;
+#endif
+
+enum tag_t : uint8_t {
+    TAG_OTHER,
+    TAG_RENDER,
+    TAG_MQTT,
+    TAG_WIFI,
+    TAG_EZTIME,
+    TAG_STRING,
+    //
+    TAG_LAST,
+};
+
+struct tag_stats_t {
+    uint32_t live_bytes;
+    uint32_t peak_bytes;
+    uint32_t allocs;
+    uint32_t alloc_bytes;
+    uint32_t allocs_per_min; // over the last full minute
+};
+
+/**
+ * Attribute allocations made by this task to a subsystem while in scope.
+ */
+class scope {
+public:
+    explicit scope(tag_t tag) noexcept;
+    ~scope() noexcept;
+
+    scope(const scope&) = delete;
+    scope& operator=(const scope&) = delete;
+
+private:
+    tag_t prev_;
+};
+
+/**
+ * Get the name of a subsystem.
+ */
+const char* tag_name(tag_t tag) noexcept;
+
+/**
+ * Get the stats of a subsystem, all zero unless `ENABLED`.
+ */
+tag_stats_t get(tag_t tag) noexcept;
+
+/**
+ * Whether some blocks went untracked, so live bytes are lower than they should
+ * be. Stays set, there's no telling when those blocks are freed.
+ */
+bool partial() noexcept;
+
+/**
+ * Sample the heap and publish stats. Call from the main loop.
+ */
+void poll() noexcept;
+
+/**
+ * Print per-subsystem stats and free heap history.
+ */
+void print_status() noexcept;
+
+/**
+ * Reset peaks and the free heap history.
+ */
+void reset_stats() noexcept;
+
+} // namespace heap_stats
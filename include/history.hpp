@@ -0,0 +1,63 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "history_log.hpp"
+
+/**
+ * Log of completed pomodoro sessions.
+ *
+ * Sessions are fixed-size records appended to a ring of files on LittleFS.
+ * Appends are batched in RAM, so flash is written a few records at a time and
+ * the newest batch may be lost on a power cut. Daily and weekly totals are kept
+ * in RAM so they can be queried without touching flash.
+ */
+namespace history {
+
+/**
+ * Mount the filesystem, find the end of the log and rebuild the totals.
+ */
+void begin() noexcept;
+
+/**
+ * Log a completed session. Only batches it in RAM, so it's cheap enough to call
+ * while drawing.
+ *
+ * @param start When the session started, in local time.
+ */
+void append(kind_t kind, uint32_t start, uint16_t duration_s) noexcept;
+
+/**
+ * Write out any batched records now.
+ */
+void flush() noexcept;
+
+/**
+ * Flush batched records once the batch is full or old enough. Call from the
+ * main loop.
+ */
+void poll() noexcept;
+
+/**
+ * Totals for the day of `now`, in local time.
+ */
+totals_t today(uint32_t now) noexcept;
+
+/**
+ * Totals for the seven days up to and including the day of `now`.
+ */
+totals_t week(uint32_t now) noexcept;
+
+/**
+ * Handle a message on `display/history/<subtopic>`.
+ *
+ * `query` publishes the totals to `display/history/stats`.
+ */
+void on_mqtt_message(const String& subtopic, uint32_t now) noexcept;
+
+/**
+ * Print log and flash write stats.
+ */
+void print_status() noexcept;
+
+} // namespace history
@@ -0,0 +1,264 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/**
+ * The session log's records and its ring of files, see history.hpp. Files are
+ * reached through `file_store_t`, so this runs on the host in the native tests.
+ */
+namespace history {
+
+enum kind_t : uint8_t {
+    KIND_WORK,
+    KIND_SHORT_BREAK,
+    KIND_LONG_BREAK,
+};
+
+struct record_t {
+    uint32_t seq;   // increases by one with every record ever written
+    uint32_t start; // local time
+    uint16_t duration_s;
+    kind_t kind;
+    uint8_t reserved;
+};
+
+static_assert(sizeof(record_t) == 12, "Records are stored as-is");
+
+struct totals_t {
+    uint16_t pomodoros;
+    uint16_t breaks;
+    uint32_t focus_seconds;
+};
+
+constexpr uint8_t NUM_FILES = 4;
+constexpr uint16_t RECORDS_PER_FILE = 512; // 6 KiB files
+
+constexpr uint8_t BATCH_LEN = 8;
+constexpr uint32_t FLUSH_INTERVAL_MS = 15 * 60 * 1000; // 15 minutes
+constexpr uint32_t RETRY_INTERVAL_MS = 60 * 1000;      // after a failed flush
+
+/**
+ * The files of the ring, by index. On the device they live on LittleFS.
+ */
+class file_store_t {
+public:
+    virtual ~file_store_t() = default;
+
+    /**
+     * Read from file `index`.
+     *
+     * @returns the bytes read, 0 past the end or if there's no such file.
+     */
+    virtual size_t read(uint8_t index, size_t offset, void* buf, size_t len) = 0;
+
+    /**
+     * Append to file `index`, or replace what's in it if `truncate`.
+     *
+     * @returns the bytes written, which may be short if the write failed.
+     */
+    virtual size_t write(uint8_t index, bool truncate, const void* data, size_t len) = 0;
+};
+
+struct log_stats_t {
+    uint32_t appends;
+    uint32_t dropped;
+    uint32_t flushes;
+    uint32_t bytes_written;
+    uint32_t rotations;
+};
+
+struct log_t {
+    file_store_t* files;
+
+    // Where the next record goes
+    uint8_t current_file;
+    uint16_t records_in_file;
+    uint32_t next_seq;
+
+    // Records waiting to be written
+    record_t batch[BATCH_LEN];
+    uint8_t batch_len;
+    uint32_t batch_started_ms;
+
+    bool flush_failed;
+    uint32_t flush_failed_ms;
+
+    log_stats_t stats;
+};
+
+/**
+ * Read every whole record in a file, oldest first.
+ *
+ * @param torn Set if the file ends in part of a record.
+ * @returns the number of records read.
+ */
+template <typename F>
+uint16_t
+for_each_record(file_store_t* files, uint8_t index, F&& fn, bool* torn = nullptr)
+{
+    record_t records[16];
+    uint16_t count = 0;
+    size_t len;
+
+    do {
+        len = files->read(index, count * sizeof(record_t), records, sizeof(records));
+
+        for (size_t i = 0; i < len / sizeof(record_t); ++i, ++count)
+            fn(records[i]);
+    } while (len == sizeof(records));
+
+    if (torn)
+        *torn = len % sizeof(record_t) != 0;
+
+    return count;
+}
+
+/**
+ * Find the end of the log, handing every record in it to `fn`.
+ */
+template <typename F>
+void
+recover(log_t* log, F&& fn)
+{
+    // The current file is the one with the newest records
+    bool found = false;
+    bool current_torn = false;
+
+    for (uint8_t index = 0; index < NUM_FILES; ++index) {
+        uint32_t last_seq = 0;
+        bool torn;
+
+        uint16_t count = for_each_record(
+            log->files,
+            index,
+            [&](const record_t& record) {
+                last_seq = record.seq;
+                fn(record);
+            },
+            &torn
+        );
+
+        if (count != 0 && (!found || last_seq >= log->next_seq)) {
+            found = true;
+            log->current_file = index;
+            log->records_in_file = count;
+            log->next_seq = last_seq + 1;
+            current_torn = torn;
+        }
+    }
+
+    // A write was cut short. Appending after the scrap would misalign every record
+    // after it, so leave the file be and start on the next one
+    if (current_torn)
+        log->records_in_file = RECORDS_PER_FILE;
+}
+
+/**
+ * Batch a record. Nothing is written, so it's cheap enough to call while
+ * drawing.
+ *
+ * @returns the record, or nullptr if the batch is full and it was dropped.
+ */
+inline const record_t*
+append(log_t* log, kind_t kind, uint32_t start, uint16_t duration_s, uint32_t now_ms) noexcept
+{
+    if (log->batch_len == BATCH_LEN) {
+        ++log->stats.dropped;
+        return nullptr;
+    }
+
+    record_t& record = log->batch[log->batch_len++];
+    record = {log->next_seq++, start, duration_s, kind, 0};
+
+    if (log->batch_len == 1)
+        log->batch_started_ms = now_ms;
+
+    ++log->stats.appends;
+    return &record;
+}
+
+/**
+ * Write the batch out to the ring, moving on to the next file when one fills up.
+ *
+ * @returns whether the whole batch was written. Whatever wasn't stays batched.
+ */
+inline bool
+write_batch(log_t* log) noexcept
+{
+    uint8_t written = 0;
+
+    while (written < log->batch_len) {
+        // Move on to the next file in the ring, dropping its old records
+        if (log->records_in_file == RECORDS_PER_FILE) {
+            log->current_file = (log->current_file + 1) % NUM_FILES;
+            log->records_in_file = 0;
+            ++log->stats.rotations;
+        }
+
+        uint16_t room = RECORDS_PER_FILE - log->records_in_file;
+        uint8_t count = log->batch_len - written < room ? log->batch_len - written : room;
+        size_t len = count * sizeof(record_t);
+
+        size_t wrote = log->files->write(
+            log->current_file, log->records_in_file == 0, log->batch + written, len
+        );
+
+        // Records that made it in whole are kept
+        uint8_t whole = wrote / sizeof(record_t);
+
+        log->records_in_file += whole;
+        written += whole;
+        log->stats.bytes_written += wrote;
+
+        if (wrote != len) {
+            // Don't append after part of a record, see recover()
+            if (wrote % sizeof(record_t) != 0)
+                log->records_in_file = RECORDS_PER_FILE;
+            break;
+        }
+    }
+
+    memmove(log->batch, log->batch + written, (log->batch_len - written) * sizeof(record_t));
+    log->batch_len -= written;
+
+    return log->batch_len == 0;
+}
+
+/**
+ * Write out any batched records now.
+ *
+ * @returns whether anything was batched.
+ */
+inline bool
+flush(log_t* log, uint32_t now_ms) noexcept
+{
+    if (log->batch_len == 0)
+        return false;
+
+    log->flush_failed = !write_batch(log);
+    if (log->flush_failed)
+        log->flush_failed_ms = now_ms;
+
+    ++log->stats.flushes;
+    return true;
+}
+
+/**
+ * Whether the batch is full or old enough to flush.
+ */
+inline bool
+flush_due(const log_t* log, uint32_t now_ms) noexcept
+{
+    if (log->batch_len == 0)
+        return false;
+
+    // Retry what's left of a failed flush, but don't hammer the filesystem
+    if (log->flush_failed)
+        return now_ms - log->flush_failed_ms >= RETRY_INTERVAL_MS;
+
+    return log->batch_len == BATCH_LEN || now_ms - log->batch_started_ms >= FLUSH_INTERVAL_MS;
+}
+
+} // namespace history
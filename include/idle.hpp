@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * Sleeping between loop iterations.
+ *
+ * The loop works out when it next has something to do and blocks until then,
+ * instead of spinning. Anything that hands it work from another task (MQTT
+ * messages, flip and reconnect timers, finished time syncs, serial input)
+ * wakes it early with `wake()`.
+ *
+ * This is a blocking wait, not light sleep: light sleep gates the APB clock the
+ * I2S DMA refreshing the panel runs on. While the loop waits, the idle task
+ * parks the CPU until the next interrupt, and WiFi keeps its modem sleep.
+ */
+namespace idle {
+
+/**
+ * Wait forever, until woken.
+ */
+constexpr int64_t NO_DEADLINE = INT64_MAX;
+
+/**
+ * Longest wait, so polled housekeeping (stats, debounced writes, console) still
+ * runs this often.
+ */
+constexpr uint32_t MAX_WAIT_MS = 1000;
+
+/**
+ * How long to wait at `now_us` for work due at `deadline_us`, both in
+ * `esp_timer_get_time()` time. Rounds up, waking a hair late rather than early
+ * and spinning.
+ */
+constexpr uint32_t
+wait_ms(int64_t now_us, int64_t deadline_us)
+{
+    if (deadline_us <= now_us)
+        return 0;
+
+    int64_t wait_us = deadline_us - now_us;
+    return wait_us < MAX_WAIT_MS * 1000LL ? (wait_us + 999) / 1000 : MAX_WAIT_MS;
+}
+
+/**
+ * When the loop next has work, once it has drawn what it could.
+ *
+ * @param flip_pending A frame is scheduled to flip, and the flip wakes the loop.
+ * @param fps Frames per second the screen needs right now, 0 if it's static.
+ * @param redraw Whether a static screen is out of date.
+ * @param frame_at_us When the next frame is due, 0 if none is waiting to be drawn.
+ * @returns an `esp_timer_get_time()` time, 0 to go again right away or
+ *   `NO_DEADLINE`.
+ */
+constexpr int64_t
+next_work_us(bool flip_pending, uint16_t fps, bool redraw, int64_t frame_at_us)
+{
+    // Without a back buffer, frames are drawn when they're due
+    if (frame_at_us)
+        return frame_at_us;
+
+    // Frames need drawing, unless one is already queued up to flip
+    if ((fps > 0 || redraw) && !flip_pending)
+        return 0;
+
+    // A flip or a change wakes us
+    return NO_DEADLINE;
+}
+
+/**
+ * Remember the loop task, and wake it on serial input. Call from `setup()`.
+ */
+void begin() noexcept;
+
+/**
+ * Wake the loop if it's waiting, or keep it from waiting next time. Safe to call
+ * from any task, but not from an ISR.
+ */
+void wake() noexcept;
+
+/**
+ * Block until `deadline_us` or `wake()`, whichever comes first. Call from the
+ * loop.
+ */
+void wait_until(int64_t deadline_us) noexcept;
+
+struct load_t {
+    uint32_t wakeups;   // waits that ended
+    uint32_t woken;     // of them, by wake()
+    uint32_t idle_us;   // spent waiting
+    uint32_t window_us; // out of
+};
+
+/**
+ * Waits over the last full second.
+ */
+load_t load() noexcept;
+
+struct stats_t {
+    uint32_t wakeups;
+    uint32_t woken;
+    int64_t idle_us;
+};
+
+/**
+ * Totals since boot or the last `reset_stats()`.
+ */
+stats_t stats() noexcept;
+
+void print_status() noexcept;
+void reset_stats() noexcept;
+
+} // namespace idle
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "metrics_response.hpp"
+
+/**
+ * Prometheus metrics over HTTP.
+ *
+ * `GET /metrics` on METRICS_PORT returns counters and gauges in the Prometheus
+ * text format. Connections are handled on the AsyncTCP task, which is pinned to
+ * core 0 (see platformio.ini), and each response is built into one static
+ * buffer, so a scrape never allocates and never competes with the loop for its
+ * core. One scrape is served at a time, others get a 503.
+ */
+namespace metrics {
+
+/**
+ * Start listening once WiFi is up. Call from the main loop.
+ */
+void poll() noexcept;
+
+void print_status() noexcept;
+
+} // namespace metrics
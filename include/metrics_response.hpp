@@ -0,0 +1,143 @@
+#pragma once
+
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+/**
+ * Writing a scrape in the Prometheus text format, see metrics.hpp. Values are
+ * handed in by the caller, so this runs on the host in the native tests.
+ */
+namespace metrics {
+
+constexpr size_t RESPONSE_LEN = 6 * 1024;
+
+struct response_t {
+    char text[RESPONSE_LEN];
+    size_t len;
+    bool overflowed; // something didn't fit, the response is cut short
+};
+
+/**
+ * Whether a request is a scrape, `GET /metrics`. Only the start of the request
+ * line is looked at.
+ */
+inline bool
+is_scrape(const char* request, size_t len) noexcept
+{
+    return len >= 13 && memcmp(request, "GET /metrics", 12) == 0
+           && (request[12] == ' ' || request[12] == '?');
+}
+
+/**
+ * Start a new response.
+ */
+inline void
+clear(response_t* response) noexcept
+{
+    response->len = 0;
+    response->overflowed = false;
+}
+
+/**
+ * Append to the response, remembering if it didn't fit.
+ */
+inline void
+append(response_t* response, const char* format, ...) noexcept
+{
+    if (response->overflowed)
+        return;
+
+    char* end = response->text + response->len;
+    size_t room = RESPONSE_LEN - response->len;
+
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(end, room, format, args);
+    va_end(args);
+
+    if (len < 0 || static_cast<size_t>(len) >= room) {
+        response->overflowed = true;
+        return;
+    }
+
+    response->len += len;
+}
+
+inline void
+describe(response_t* response, const char* name, const char* type, const char* help) noexcept
+{
+    append(response, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+inline void
+counter(response_t* response, const char* name, const char* help, uint32_t value) noexcept
+{
+    describe(response, name, "counter", help);
+    append(response, "%s %lu\n", name, static_cast<unsigned long>(value));
+}
+
+/**
+ * A counter of seconds, kept in microseconds.
+ */
+inline void
+counter_us(response_t* response, const char* name, const char* help, int64_t value_us) noexcept
+{
+    describe(response, name, "counter", help);
+    append(
+        response,
+        "%s %lld.%06lld\n",
+        name,
+        static_cast<long long>(value_us / 1000000),
+        static_cast<long long>(value_us % 1000000)
+    );
+}
+
+inline void
+gauge(response_t* response, const char* name, const char* help, double value) noexcept
+{
+    describe(response, name, "gauge", help);
+    append(response, "%s %.10g\n", name, value);
+}
+
+/**
+ * A histogram of durations from per-bucket counts. `counts` has one more entry
+ * than `bounds_ms`, for everything past the last bound.
+ */
+inline void
+histogram_ms(
+    response_t* response,
+    const char* name,
+    const char* help,
+    const uint32_t* bounds_ms,
+    size_t bounds,
+    const uint32_t* counts,
+    int64_t sum_us
+) noexcept
+{
+    describe(response, name, "histogram", help);
+
+    // Buckets are cumulative
+    unsigned long count = 0;
+    for (size_t i = 0; i < bounds; ++i) {
+        count += counts[i];
+        append(response, "%s_bucket{le=\"%g\"} %lu\n", name, bounds_ms[i] / 1e3, count);
+    }
+
+    count += counts[bounds];
+    append(response, "%s_bucket{le=\"+Inf\"} %lu\n", name, count);
+
+    append(
+        response,
+        "%s_sum %lld.%06lld\n%s_count %lu\n",
+        name,
+        static_cast<long long>(sum_us / 1000000),
+        static_cast<long long>(sum_us % 1000000),
+        name,
+        count
+    );
+}
+
+} // namespace metrics
@@ -0,0 +1,135 @@
+#pragma once
+
+#include "clock.hpp"
+#include "geometry.hpp"
+#include "pomodoro.hpp"
+#include "ticker.hpp"
+
+#include <Arduino.h>
+#include <Adafruit_GFX.h>
+#include <ezTime.h>
+
+#include <iterator>
+
+/**
+ * Every display mode, and how often it needs drawing.
+ *
+ * A mode's number (as sent to display/mode) is its index in `MODES`, so adding a
+ * mode means adding an entry at the end.
+ */
+namespace modes {
+
+/**
+ * Everything a mode gets to draw a frame.
+ */
+struct frame_t {
+    Adafruit_GFX* gfx;
+    Timezone* local_tz;
+    time_t now;    // UTC second the frame shows in
+    int64_t at_us; // `esp_timer_get_time()` the frame shows at
+    uint16_t color;
+
+    /**
+     * Only show what's on screen, without moving the mode on: no period
+     * transitions, no new messages. Set for the outgoing frame of a crossfade.
+     */
+    bool snapshot;
+};
+
+struct mode_t {
+    const char* name;
+    void (*draw)(const frame_t& frame);
+
+    /**
+     * Frames per second while animating, 0 for a screen that only changes
+     * when settings do.
+     */
+    uint16_t fps;
+
+    /**
+     * Whether the mode animates right now, always if null. Otherwise it's
+     * drawn once and left alone.
+     */
+    bool (*animating)();
+
+    /**
+     * Whether the mode has nothing to show without the network. While MQTT is
+     * down it shows `FALLBACK` instead, see `shown()`.
+     */
+    bool needs_network;
+
+    /**
+     * Whether the mode shows the time, so can't be drawn until NTP has synced.
+     */
+    bool needs_time;
+};
+
+inline constexpr mode_t MODES[] = {
+    {
+        "clock",
+        [](const frame_t& f) {
+            matrix_clock::draw<panel_geometry>(f.gfx, f.local_tz, f.now, f.color);
+        },
+        1,
+        nullptr,
+        false,
+        true,
+    },
+    {
+        "pomodoro",
+        [](const frame_t& f) {
+            pomodoro::draw<panel_geometry>(f.gfx, f.local_tz, f.now, f.color, f.snapshot);
+        },
+        1,
+        nullptr,
+        false,
+        true,
+    },
+    {
+        "ticker",
+        [](const frame_t& f) {
+            ticker::draw<panel_geometry>(f.gfx, f.at_us, f.color, f.snapshot);
+        },
+        ticker::FPS,
+        ticker::is_active,
+        true,
+        false,
+    },
+};
+
+constexpr int8_t COUNT = std::size(MODES);
+
+/**
+ * Shown in place of modes that need the network while it's down: the clock.
+ */
+constexpr int8_t FALLBACK = 0;
+
+/**
+ * Mode number from a name or a number, -1 if there is no such mode.
+ */
+int8_t parse(const char* str) noexcept;
+
+/**
+ * Frames per second `mode` needs right now, 0 if it doesn't need any. -1 is
+ * the blank screen.
+ */
+uint16_t frame_rate(int8_t mode) noexcept;
+
+/**
+ * The mode to show for `mode`, `FALLBACK` if it needs the network, MQTT is down
+ * and it's done animating what it already had. -1 is the blank screen.
+ */
+int8_t shown(int8_t mode, bool mqtt_connected) noexcept;
+
+/**
+ * Whether `mode` can be drawn yet: the clock is set, or the mode doesn't show
+ * the time. -1 is the blank screen.
+ */
+bool can_draw(int8_t mode, bool time_set) noexcept;
+
+/**
+ * Print the registry.
+ */
+void print_status() noexcept;
+
+} // namespace modes
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "ota_session.hpp"
+
+/**
+ * Firmware updates streamed over MQTT.
+ *
+ * The image is sent in sequenced chunks and written straight into the inactive
+ * OTA partition while being hashed, so it is never buffered in full. Progress is
+ * acknowledged on `display/ota/status`, and a sender resumes from the last
+ * acknowledged chunk after a disconnect.
+ *
+ * Any client of the broker can publish to these topics, so an image is only
+ * taken if its `begin` carries the HMAC-SHA256 of its hash under `OTA_KEY` from
+ * config.h. Without a key, updates are refused. The HMAC doesn't stop an old
+ * signed image from being replayed, so rotate the key to revoke one.
+ *
+ * Topics, relative to `display/ota/`:
+ *  - `begin`: "<size> <sha256 hex> <hmac hex>", starts (or resumes) an update
+ *  - `chunk`: little-endian uint32 sequence number followed by data
+ *  - `abort`: anything, throws away a running update
+ *  - `status`: published by us, "<state> <next seq> <bytes written> <KB/s>"
+ */
+namespace ota {
+
+/**
+ * Handle a message on one of the OTA topics.
+ *
+ * @param subtopic Topic with the `display/ota/` prefix removed.
+ */
+void on_mqtt_message(const char* subtopic, const uint8_t* payload, size_t length) noexcept;
+
+/**
+ * Re-announce our progress so a sender knows where to resume.
+ */
+void on_mqtt_connect() noexcept;
+
+/**
+ * Restart into a newly written image. Call from the main loop.
+ */
+void poll() noexcept;
+
+/**
+ * Print the state of the current update.
+ */
+void print_status() noexcept;
+
+} // namespace ota
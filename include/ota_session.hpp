@@ -0,0 +1,239 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+
+/**
+ * The OTA protocol, see ota.hpp: which chunks to take, when an image is done
+ * and when it's bad. Writing and hashing go through `flash_writer_t`, so this
+ * runs on the host in the native tests.
+ */
+namespace ota {
+
+constexpr size_t SEQ_LEN = sizeof(uint32_t);
+constexpr size_t SHA256_LEN = 32;
+
+enum state_t : uint8_t {
+    STATE_IDLE,
+    STATE_RECEIVING,
+    STATE_DONE,
+    STATE_FAILED,
+};
+
+/**
+ * Where an image goes. On the device that's the inactive OTA partition.
+ *
+ * Calls that can fail return a reason, or nullptr if they didn't.
+ */
+class flash_writer_t {
+public:
+    virtual ~flash_writer_t() = default;
+
+    /**
+     * Largest image that fits, 0 if there's nowhere to write one.
+     */
+    virtual size_t capacity() = 0;
+
+    /**
+     * Start writing an image of `size` bytes, dropping anything written before.
+     */
+    virtual const char* begin(size_t size) = 0;
+
+    /**
+     * Append to the image and its hash.
+     */
+    virtual const char* write(const uint8_t* data, size_t len) = 0;
+
+    /**
+     * SHA-256 of everything written since `begin()`. Call once, then `commit()`
+     * or `abort()`.
+     */
+    virtual void digest(uint8_t* sha) = 0;
+
+    /**
+     * Check the image and boot into it next time.
+     */
+    virtual const char* commit() = 0;
+
+    /**
+     * Throw away the image being written.
+     */
+    virtual void abort() = 0;
+};
+
+/**
+ * What happened to a session, and what to tell the sender.
+ */
+enum event_t : uint8_t {
+    EVENT_NONE,    // a malformed message, nothing to tell
+    EVENT_ACK,     // a chunk was written
+    EVENT_REWIND,  // a chunk was out of order, the sender resumes from `next_seq`
+    EVENT_STARTED, // a new image
+    EVENT_RESUMED, // the image in progress was announced again
+    EVENT_DONE,    // the image is written and will boot
+    EVENT_FAILED,  // see `error`
+};
+
+struct session_t {
+    flash_writer_t* writer;
+    state_t state;
+
+    size_t image_size;
+    uint8_t expected_sha[SHA256_LEN];
+
+    uint32_t next_seq;
+    size_t bytes_written;
+
+    const char* error; // why the last update failed
+};
+
+/**
+ * Value of a hex digit, -1 if it isn't one.
+ */
+constexpr int
+hex_digit(char c)
+{
+    return c >= '0' && c <= '9'   ? c - '0'
+           : c >= 'a' && c <= 'f' ? c - 'a' + 10
+           : c >= 'A' && c <= 'F' ? c - 'A' + 10
+                                  : -1;
+}
+
+/**
+ * Parse a begin message, "<size> <sha256 hex> <hmac hex>". `args` is
+ * null-terminated.
+ */
+inline bool
+parse_begin(const char* args, size_t* size, uint8_t* sha, uint8_t* mac) noexcept
+{
+    char* end;
+    unsigned long value = strtoul(args, &end, 10);
+    if (end == args || value == 0)
+        return false;
+
+    const char* p = end;
+    for (uint8_t* out : {sha, mac}) {
+        while (*p == ' ')
+            ++p;
+
+        for (size_t i = 0; i < SHA256_LEN; ++i) {
+            int high = hex_digit(*p++);
+            int low = high < 0 ? -1 : hex_digit(*p++);
+            if (low < 0)
+                return false;
+
+            out[i] = static_cast<uint8_t>(high << 4 | low);
+        }
+    }
+
+    *size = value;
+    return *p == '\0';
+}
+
+/**
+ * Stop a running update and mark it failed.
+ */
+inline event_t
+fail(session_t* s, const char* reason) noexcept
+{
+    if (s->state == STATE_RECEIVING)
+        s->writer->abort();
+
+    s->state = STATE_FAILED;
+    s->error = reason;
+
+    return EVENT_FAILED;
+}
+
+/**
+ * Start an update, or resume it if it's the one in progress. The image's hash
+ * must have been authenticated already.
+ */
+inline event_t
+begin(session_t* s, size_t size, const uint8_t* sha) noexcept
+{
+    // Same image as the one in progress, the sender is resuming
+    if (s->state == STATE_RECEIVING && size == s->image_size
+        && memcmp(sha, s->expected_sha, SHA256_LEN) == 0)
+        return EVENT_RESUMED;
+
+    if (s->state == STATE_RECEIVING)
+        s->writer->abort();
+
+    if (size > s->writer->capacity()) {
+        s->state = STATE_IDLE; // nothing to abort
+        return fail(s, "Image too large for partition");
+    }
+
+    const char* error = s->writer->begin(size);
+    if (error) {
+        s->state = STATE_IDLE;
+        return fail(s, error);
+    }
+
+    s->image_size = size;
+    memcpy(s->expected_sha, sha, SHA256_LEN);
+
+    s->next_seq = 0;
+    s->bytes_written = 0;
+    s->state = STATE_RECEIVING;
+
+    return EVENT_STARTED;
+}
+
+/**
+ * Take a chunk, a little-endian sequence number followed by data.
+ */
+inline event_t
+chunk(session_t* s, const uint8_t* payload, size_t length) noexcept
+{
+    // Let the sender know we aren't expecting chunks
+    if (s->state != STATE_RECEIVING)
+        return EVENT_REWIND;
+
+    if (length <= SEQ_LEN)
+        return EVENT_NONE;
+
+    uint32_t seq = payload[0] | (payload[1] << 8) | (payload[2] << 16)
+                   | (static_cast<uint32_t>(payload[3]) << 24);
+
+    // Duplicates and chunks from the future get our position, the sender rewinds
+    if (seq != s->next_seq)
+        return EVENT_REWIND;
+
+    const uint8_t* data = payload + SEQ_LEN;
+    size_t data_len = length - SEQ_LEN;
+
+    if (data_len > s->image_size - s->bytes_written)
+        return fail(s, "Image longer than announced");
+
+    const char* error = s->writer->write(data, data_len);
+    if (error)
+        return fail(s, error);
+
+    s->bytes_written += data_len;
+    ++s->next_seq;
+
+    if (s->bytes_written < s->image_size)
+        return EVENT_ACK;
+
+    uint8_t sha[SHA256_LEN];
+    s->writer->digest(sha);
+
+    if (memcmp(sha, s->expected_sha, SHA256_LEN) != 0)
+        return fail(s, "SHA256 mismatch");
+
+    error = s->writer->commit();
+    if (error) {
+        s->state = STATE_FAILED; // the image is gone, nothing to abort
+        return fail(s, error);
+    }
+
+    s->state = STATE_DONE;
+    return EVENT_DONE;
+}
+
+} // namespace ota
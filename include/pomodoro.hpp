@@ -2,14 +2,87 @@
 #include <AsyncMqttClient.hpp>
 #include <ezTime.h>
 
-#include <ESP32-HUB75-MatrixPanel-I2S-DMA.h>
+#include <Adafruit_GFX.h>
 
+#include "pomodoro_session.hpp"
+
+/**
+ * Pomodoro timer.
+ *
+ * In group mode (display/pomodoro/group = 1) displays share one session. Every
+ * transition is published retained to display/pomodoro/session with a Lamport
+ * version, the newest version wins (ties go to the higher node id), and each
+ * display counts down to the shared deadline on its own disciplined clock.
+ */
 namespace pomodoro {
 
+/**
+ * Pick a node id for group mode.
+ */
+void begin() noexcept;
+
+/**
+ * Take a display/pomodoro/<topic> message. Safe to call from the MQTT task, it
+ * takes effect at the next `poll()`.
+ */
 void on_mqtt_message(
     String& subtopic, String& payload, AsyncMqttClientMessageProperties props
 );
 
-void draw(MatrixPanel_I2S_DMA* display, Timezone* local_tz);
+/**
+ * Whether a display/pomodoro/session message is one of ours coming back from
+ * the broker, which there's no point parsing. Safe to call from the MQTT task.
+ */
+bool is_own_echo(const uint8_t* payload, size_t length) noexcept;
+
+/**
+ * Draw the pomodoro timer as of `now` (UTC), moving on to the next period once
+ * its deadline passes, unless drawing a `snapshot`.
+ *
+ * Instantiated in pomodoro.cpp for `panel_geometry`.
+ */
+template <typename G>
+void draw(Adafruit_GFX* gfx, Timezone* local_tz, time_t now, uint16_t color, bool snapshot);
+
+/**
+ * Apply received messages, and publish the count and session after a period
+ * ends. Call from the main loop, outside of drawing.
+ */
+void poll() noexcept;
+
+/**
+ * Set how many minutes a period lasts, from the next one on. Call from the main
+ * loop.
+ *
+ * @param period 0 for work, 1 for a short break, 2 for a long break.
+ */
+void set_minutes(int8_t period, uint8_t minutes) noexcept;
+
+/**
+ * How many minutes a period lasts, see `set_minutes()`.
+ */
+uint8_t minutes(int8_t period) noexcept;
+
+/**
+ * Start over with a work period and no completed pomodoros. Call from the main
+ * loop.
+ */
+void reset() noexcept;
+
+/**
+ * Current mode: 0 for work, 1 for a short break, 2 for a long break, -1 before
+ * the first period.
+ */
+int8_t current_mode() noexcept;
+
+/**
+ * Pomodoros completed since the last reset.
+ */
+uint32_t completed() noexcept;
+
+/**
+ * Print group mode state and transition latency.
+ */
+void print_status() noexcept;
 
 } // namespace pomodoro
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <ctime>
+
+/**
+ * Group mode's shared session, see pomodoro.hpp: which of the sessions going
+ * around a display should run. Nothing here touches MQTT or the clock, so it
+ * runs on the host in the native tests.
+ */
+namespace pomodoro {
+
+struct session_id_t {
+    uint32_t version; // Lamport clock
+    uint32_t origin;  // node that wrote it
+
+    bool
+    operator>(const session_id_t& other) const
+    {
+        return version != other.version ? version > other.version : origin > other.origin;
+    }
+};
+
+struct session_t {
+    session_id_t id;
+    int8_t mode; // like `current_mode()`
+    time_t deadline;
+    uint32_t period_seconds;
+    uint32_t count;
+    int64_t sent_ms; // sender's wall clock, for measuring latency
+};
+
+/**
+ * What a display knows of the group.
+ */
+struct group_t {
+    uint32_t node_id;
+    uint32_t lamport;
+    bool enabled;
+
+    session_id_t shown;    // the session we're running
+    session_t latest;      // newest one seen, even outside group mode
+    bool have_latest;
+};
+
+/**
+ * Parse "<version> <origin> <mode> <deadline> <period> <count> <sent ms>".
+ */
+inline bool
+parse_session(const char* str, session_t* session) noexcept
+{
+    char* end;
+    long long fields[7];
+
+    for (long long& field : fields) {
+        field = strtoll(str, &end, 10);
+        if (end == str)
+            return false;
+
+        str = end;
+    }
+
+    if (fields[2] < 0 || fields[2] > 2)
+        return false;
+
+    session->id = {static_cast<uint32_t>(fields[0]), static_cast<uint32_t>(fields[1])};
+    session->mode = static_cast<int8_t>(fields[2]);
+    session->deadline = fields[3];
+    session->period_seconds = fields[4];
+    session->count = fields[5];
+    session->sent_ms = fields[6];
+
+    return true;
+}
+
+/**
+ * Read the id off a session message without copying it. `payload` needn't be
+ * null-terminated.
+ */
+inline bool
+peek_id(const uint8_t* payload, size_t length, session_id_t* id) noexcept
+{
+    uint32_t fields[2];
+    size_t i = 0;
+
+    for (uint32_t& field : fields) {
+        while (i < length && payload[i] == ' ')
+            ++i;
+
+        size_t start = i;
+        uint64_t value = 0;
+
+        for (; i < length && payload[i] >= '0' && payload[i] <= '9'; ++i) {
+            value = value * 10 + (payload[i] - '0');
+            if (value > UINT32_MAX)
+                return false;
+        }
+
+        if (i == start)
+            return false;
+
+        field = static_cast<uint32_t>(value);
+    }
+
+    *id = {fields[0], fields[1]};
+    return true;
+}
+
+/**
+ * Whether a session is one we published, coming back from the broker. Ours from
+ * before a reboot is newer than anything we've seen since, and isn't.
+ */
+inline bool
+is_echo(const group_t& group, const session_id_t& id) noexcept
+{
+    return id.origin == group.node_id && id.version <= group.lamport;
+}
+
+/**
+ * Id for a session we're about to publish, newer than anything we've seen.
+ */
+inline session_id_t
+next_id(group_t* group) noexcept
+{
+    group->shown = {++group->lamport, group->node_id};
+    return group->shown;
+}
+
+/**
+ * Take in a session from the group, ours included.
+ *
+ * @returns whether to switch to it.
+ */
+inline bool
+merge(group_t* group, const session_t& session) noexcept
+{
+    // Last writer wins, even if we're not in group mode yet
+    if (session.id.version > group->lamport)
+        group->lamport = session.id.version;
+
+    if (!group->have_latest || session.id > group->latest.id) {
+        group->latest = session;
+        group->have_latest = true;
+    }
+
+    if (!group->enabled || !(session.id > group->shown))
+        return false;
+
+    group->shown = session.id;
+    return true;
+}
+
+/**
+ * Turn group mode on and catch up with the group.
+ *
+ * @returns the session to switch to, or nullptr if we haven't seen one and
+ *   should start the group off with ours.
+ */
+inline const session_t*
+join(group_t* group) noexcept
+{
+    group->enabled = true;
+    if (!group->have_latest)
+        return nullptr;
+
+    group->shown = group->latest.id;
+    return &group->latest;
+}
+
+} // namespace pomodoro
@@ -0,0 +1,138 @@
+#pragma once
+
+#include "frame.hpp"
+
+#include <Arduino.h>
+#include <Adafruit_GFX.h>
+
+#include <cstdint>
+
+/**
+ * Progress indicators that are drawn incrementally.
+ *
+ * Each draw only lights the pixels that became elapsed since the indicator was
+ * last drawn into the back buffer. Starting a new period (a different
+ * `period_id`) or a full frame redraw repaints it from scratch.
+ */
+namespace progress {
+
+/**
+ * Base for indicators made of `Length` pixels, which `Derived` maps to spans of
+ * the display with `draw_span(gfx, from, to, color)`.
+ */
+template <typename Derived, uint16_t Length>
+class indicator {
+public:
+    static constexpr uint16_t length = Length;
+
+    /**
+     * Draw the indicator.
+     *
+     * @param elapsed How far along the period is, in any unit.
+     * @param total The length of the period, in the same unit as `elapsed`.
+     * @param period_id Identifies the period, changing it restarts the indicator.
+     */
+    void
+    draw(Adafruit_GFX* gfx, uint32_t elapsed, uint32_t total, uint32_t period_id, uint16_t color)
+    {
+        state_t& prev = state_[frame::back_buffer()];
+
+        uint16_t lit = total ? static_cast<uint64_t>(min(elapsed, total)) * Length / total
+                             : Length;
+
+        bool restart = frame::needs_full_redraw() || !prev.valid
+                       || prev.period_id != period_id || prev.color != color
+                       || lit < prev.lit;
+
+        if (restart) {
+            // The frame was cleared if it needed a full redraw
+            if (!frame::needs_full_redraw())
+                derived().draw_span(gfx, 0, Length, 0);
+
+            prev = {true, period_id, color, 0};
+        }
+
+        if (lit > prev.lit)
+            derived().draw_span(gfx, prev.lit, lit, color);
+
+        prev.lit = lit;
+    }
+
+private:
+    struct state_t {
+        bool valid;
+        uint32_t period_id;
+        uint16_t color;
+        uint16_t lit;
+    };
+
+    state_t state_[frame::BUFFER_COUNT]{};
+
+    Derived&
+    derived()
+    {
+        return static_cast<Derived&>(*this);
+    }
+};
+
+/**
+ * A ring around the border, filling clockwise from the top left corner.
+ */
+template <typename G>
+class ring : public indicator<ring<G>, 2 * (G::width + G::height) - 4> {
+public:
+    void
+    draw_span(Adafruit_GFX* gfx, uint16_t from, uint16_t to, uint16_t color)
+    {
+        constexpr int16_t W = G::width;
+        constexpr int16_t H = G::height;
+
+        // First index of each edge
+        constexpr int16_t RIGHT = W;
+        constexpr int16_t BOTTOM = W + H - 1;
+        constexpr int16_t LEFT = 2 * W + H - 2;
+        constexpr int16_t END = 2 * (W + H) - 4;
+
+        int16_t a, b;
+
+        // Top, left to right
+        if (clip(from, to, 0, RIGHT, &a, &b))
+            gfx->drawFastHLine(a, 0, b - a, color);
+
+        // Right, top to bottom
+        if (clip(from, to, RIGHT, BOTTOM, &a, &b))
+            gfx->drawFastVLine(W - 1, a - RIGHT + 1, b - a, color);
+
+        // Bottom, right to left
+        if (clip(from, to, BOTTOM, LEFT, &a, &b))
+            gfx->drawFastHLine(W - 1 - (b - BOTTOM), H - 1, b - a, color);
+
+        // Left, bottom to top
+        if (clip(from, to, LEFT, END, &a, &b))
+            gfx->drawFastVLine(0, H - 1 - (b - LEFT), b - a, color);
+    }
+
+private:
+    static bool
+    clip(int16_t from, int16_t to, int16_t lo, int16_t hi, int16_t* a, int16_t* b)
+    {
+        *a = max(from, lo);
+        *b = min(to, hi);
+        return *a < *b;
+    }
+};
+
+/**
+ * A bar along the bottom row, filling left to right.
+ */
+template <typename G>
+class bar : public indicator<bar<G>, G::width> {
+public:
+    void
+    draw_span(Adafruit_GFX* gfx, uint16_t from, uint16_t to, uint16_t color)
+    {
+        gfx->drawFastHLine(from, G::height - 1, to - from, color);
+    }
+};
+
+} // namespace progress
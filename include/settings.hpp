@@ -0,0 +1,64 @@
+#pragma once
+
+#include "settings_record.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Batched settings on display/config.
+ *
+ * One binary record carries any subset of the display and pomodoro settings:
+ *
+ *  version (1) | fields (1) | each field in `field_t` order, if present
+ *
+ *  FIELD_MODE         mode index (1)
+ *  FIELD_COLOR        red, green, blue (3)
+ *  FIELD_BRIGHTNESS   brightness (1)
+ *  FIELD_WORK         minutes (1)
+ *  FIELD_SHORT_BREAK  minutes (1)
+ *  FIELD_LONG_BREAK   minutes (1)
+ *  FIELD_RESET        nothing, restarts the pomodoro timer
+ *
+ * A record is checked as a whole, anything wrong with it rejects all of it, see
+ * settings_record.hpp. Accepted records are applied together between frames.
+ *
+ * The current settings are kept in NVS in the same format, so a reboot comes
+ * back up in the same mode, color and brightness without waiting for retained
+ * messages. Modes that show the time still wait for NTP, the rest are drawn
+ * right away. Writes wait for the settings to stop changing and are spaced
+ * out, failed ones included, which bounds flash wear no matter how chatty the
+ * broker is.
+ */
+namespace settings {
+
+/**
+ * Take a display/config message. Safe to call from the MQTT task, it takes
+ * effect at the next `take()`.
+ */
+void on_mqtt_message(const uint8_t* payload, size_t len) noexcept;
+
+/**
+ * Pick up the settings received since the last call, merged into one record.
+ * Call between frames.
+ *
+ * @returns whether there were any.
+ */
+bool take(record_t* record) noexcept;
+
+/**
+ * Load the settings saved by `poll()`. Call once, early in `setup()`.
+ *
+ * @returns whether there were any.
+ */
+bool restore(record_t* record) noexcept;
+
+/**
+ * Save `current` to NVS once it has stopped changing for a while. Call from the
+ * main loop.
+ */
+void poll(const record_t& current) noexcept;
+
+void print_status() noexcept;
+
+} // namespace settings
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/**
+ * The display/config record format, see settings.hpp.
+ *
+ * Packing and checking records is plain byte shuffling with no Arduino
+ * dependencies, so it runs on the host in the native tests.
+ */
+namespace settings {
+
+constexpr uint8_t VERSION = 1;
+
+enum field_t : uint8_t {
+    FIELD_MODE = 1 << 0,
+    FIELD_COLOR = 1 << 1,
+    FIELD_BRIGHTNESS = 1 << 2,
+    FIELD_WORK = 1 << 3,
+    FIELD_SHORT_BREAK = 1 << 4,
+    FIELD_LONG_BREAK = 1 << 5,
+    FIELD_RESET = 1 << 6,
+};
+
+constexpr uint8_t ALL_FIELDS = (FIELD_RESET << 1) - 1;
+
+struct record_t {
+    uint8_t fields; // which of the rest are set, see `field_t`
+    int8_t mode;
+    uint8_t color[3]; // r, g, b
+    uint8_t brightness;
+    uint8_t minutes[3]; // work, short break, long break, like `pomodoro::current_mode()`
+};
+
+/**
+ * Length of a record with `fields` set, header included.
+ */
+constexpr size_t
+record_len(uint8_t fields)
+{
+    return 2 + (fields & FIELD_MODE ? 1 : 0) + (fields & FIELD_COLOR ? 3 : 0)
+           + (fields & FIELD_BRIGHTNESS ? 1 : 0) + (fields & FIELD_WORK ? 1 : 0)
+           + (fields & FIELD_SHORT_BREAK ? 1 : 0) + (fields & FIELD_LONG_BREAK ? 1 : 0);
+}
+
+/**
+ * Longest record, with every field.
+ */
+constexpr size_t MAX_LEN = record_len(ALL_FIELDS);
+
+static_assert(MAX_LEN == 10, "Record layout changed, bump VERSION");
+
+/**
+ * Pack `record` into `out`.
+ *
+ * @returns the record's length, or 0 if it doesn't fit in `size`.
+ */
+inline size_t
+encode(const record_t& record, uint8_t* out, size_t size) noexcept
+{
+    size_t len = record_len(record.fields);
+    if ((record.fields & ~ALL_FIELDS) || len > size)
+        return 0;
+
+    uint8_t* p = out;
+
+    *p++ = VERSION;
+    *p++ = record.fields;
+
+    if (record.fields & FIELD_MODE)
+        *p++ = record.mode;
+    if (record.fields & FIELD_COLOR) {
+        memcpy(p, record.color, sizeof(record.color));
+        p += sizeof(record.color);
+    }
+    if (record.fields & FIELD_BRIGHTNESS)
+        *p++ = record.brightness;
+    if (record.fields & FIELD_WORK)
+        *p++ = record.minutes[0];
+    if (record.fields & FIELD_SHORT_BREAK)
+        *p++ = record.minutes[1];
+    if (record.fields & FIELD_LONG_BREAK)
+        *p++ = record.minutes[2];
+
+    return len;
+}
+
+/**
+ * Unpack and check a record.
+ *
+ * @param mode_count Number of display modes, `modes::COUNT`.
+ * @returns whether `data` is a valid record, `record` is only written if so.
+ */
+inline bool
+decode(const uint8_t* data, size_t len, int8_t mode_count, record_t* record) noexcept
+{
+    if (len < 2 || data[0] != VERSION)
+        return false;
+
+    uint8_t fields = data[1];
+    if ((fields & ~ALL_FIELDS) || len != record_len(fields))
+        return false;
+
+    record_t r{};
+    const uint8_t* p = data + 2;
+
+    r.fields = fields;
+
+    if (fields & FIELD_MODE) {
+        r.mode = static_cast<int8_t>(*p++);
+        if (r.mode < 0 || r.mode >= mode_count)
+            return false;
+    }
+    if (fields & FIELD_COLOR) {
+        memcpy(r.color, p, sizeof(r.color));
+        p += sizeof(r.color);
+    }
+    if (fields & FIELD_BRIGHTNESS)
+        r.brightness = *p++;
+    if (fields & FIELD_WORK)
+        r.minutes[0] = *p++;
+    if (fields & FIELD_SHORT_BREAK)
+        r.minutes[1] = *p++;
+    if (fields & FIELD_LONG_BREAK)
+        r.minutes[2] = *p++;
+
+    *record = r;
+    return true;
+}
+
+} // namespace settings
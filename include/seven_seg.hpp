@@ -0,0 +1,265 @@
+#pragma once
+
+#include "frame.hpp"
+
+#include <Arduino.h>
+#include <Adafruit_GFX.h>
+
+#include <cstdint>
+
+/**
+ * Large 7-segment style digits.
+ *
+ * Glyphs are precomputed segment bitmasks and every segment is a filled rect,
+ * so drawing never goes through the GFX text path. Redraws only touch the
+ * segments that differ from what the back buffer already shows.
+ */
+namespace seven_seg {
+
+/*
+ *  -a-
+ * f   b
+ *  -g-
+ * e   c
+ *  -d-
+ */
+enum segment_t : uint8_t {
+    SEG_A = 1 << 0,
+    SEG_B = 1 << 1,
+    SEG_C = 1 << 2,
+    SEG_D = 1 << 3,
+    SEG_E = 1 << 4,
+    SEG_F = 1 << 5,
+    SEG_G = 1 << 6,
+};
+
+constexpr uint8_t SEGMENT_COUNT = 7;
+
+constexpr uint8_t DIGIT_MASKS[10] = {
+    SEG_A | SEG_B | SEG_C | SEG_D | SEG_E | SEG_F,         // 0
+    SEG_B | SEG_C,                                         // 1
+    SEG_A | SEG_B | SEG_D | SEG_E | SEG_G,                 // 2
+    SEG_A | SEG_B | SEG_C | SEG_D | SEG_G,                 // 3
+    SEG_B | SEG_C | SEG_F | SEG_G,                         // 4
+    SEG_A | SEG_C | SEG_D | SEG_F | SEG_G,                 // 5
+    SEG_A | SEG_C | SEG_D | SEG_E | SEG_F | SEG_G,         // 6
+    SEG_A | SEG_B | SEG_C,                                 // 7
+    SEG_A | SEG_B | SEG_C | SEG_D | SEG_E | SEG_F | SEG_G, // 8
+    SEG_A | SEG_B | SEG_C | SEG_D | SEG_F | SEG_G,         // 9
+};
+
+// Colons reuse the low two bits for their dots
+constexpr uint8_t COLON_MASK = SEG_A | SEG_B;
+
+/**
+ * Size of a digit, in pixels.
+ *
+ * `height - 3 * thickness` must be even so both halves are the same height.
+ */
+struct style_t {
+    uint8_t width;
+    uint8_t height;
+    uint8_t thickness;
+    uint8_t spacing; // between glyphs
+};
+
+constexpr style_t SMALL{5, 9, 1, 1};
+constexpr style_t MEDIUM{8, 16, 2, 1};
+constexpr style_t LARGE{10, 19, 3, 2};
+constexpr style_t HUGE{16, 30, 4, 3};
+
+// Largest first, see fit()
+constexpr style_t STYLES[] = {HUGE, LARGE, MEDIUM, SMALL};
+
+struct rect_t {
+    uint8_t x, y, w, h;
+};
+
+constexpr bool
+is_valid(const style_t& s)
+{
+    return s.width > 2 * s.thickness && s.height > 3 * s.thickness
+           && (s.height - 3 * s.thickness) % 2 == 0;
+}
+
+/**
+ * Width of a glyph, in pixels.
+ */
+constexpr uint8_t
+glyph_width(const style_t& s, char c)
+{
+    return c == ':' ? s.thickness : s.width;
+}
+
+/**
+ * Width of a string rendered in a style, in pixels.
+ */
+constexpr uint16_t
+text_width(const style_t& s, const char* text)
+{
+    uint16_t w = 0;
+    for (const char* c = text; *c; ++c)
+        w += glyph_width(s, *c) + (c == text ? 0 : s.spacing);
+
+    return w;
+}
+
+/**
+ * Pick the largest style that fits `text` in a `max_w` by `max_h` box.
+ */
+constexpr style_t
+fit(const char* text, uint16_t max_w, uint16_t max_h)
+{
+    for (const style_t& s : STYLES) {
+        if (text_width(s, text) <= max_w && s.height <= max_h)
+            return s;
+    }
+
+    return SMALL;
+}
+
+/**
+ * Position of a segment relative to the top left of its glyph.
+ */
+constexpr rect_t
+segment_rect(const style_t& s, uint8_t segment)
+{
+    const uint8_t t = s.thickness;
+    const uint8_t half = (s.height - 3 * t) / 2;
+    const uint8_t inner_w = s.width - 2 * t;
+
+    switch (segment) {
+        case 0: // a
+            return {t, 0, inner_w, t};
+        case 1: // b
+            return {static_cast<uint8_t>(s.width - t), t, t, half};
+        case 2: // c
+            return {static_cast<uint8_t>(s.width - t), static_cast<uint8_t>(2 * t + half), t, half};
+        case 3: // d
+            return {t, static_cast<uint8_t>(s.height - t), inner_w, t};
+        case 4: // e
+            return {0, static_cast<uint8_t>(2 * t + half), t, half};
+        case 5: // f
+            return {0, t, t, half};
+        default: // g
+            return {t, static_cast<uint8_t>(t + half), inner_w, t};
+    }
+}
+
+/**
+ * Position of a colon dot relative to the top left of its glyph.
+ */
+constexpr rect_t
+colon_rect(const style_t& s, uint8_t dot)
+{
+    const uint8_t third = s.height / 3;
+    return {0, static_cast<uint8_t>((dot + 1) * third - s.thickness / 2), s.thickness, s.thickness};
+}
+
+/**
+ * Segment mask of a character. Anything that isn't a digit, '-' or ':' is blank.
+ */
+constexpr uint8_t
+glyph_mask(char c)
+{
+    return c >= '0' && c <= '9' ? DIGIT_MASKS[c - '0']
+           : c == '-'           ? SEG_G
+           : c == ':'           ? COLON_MASK
+                                : 0;
+}
+
+/**
+ * A run of up to `N` glyphs, remembering what it drew into each buffer.
+ */
+template <size_t N>
+class renderer {
+public:
+    explicit renderer(const style_t& style) noexcept : style_(style)
+    {
+        assert(is_valid(style));
+
+        for (uint8_t seg = 0; seg < SEGMENT_COUNT; ++seg)
+            segments_[seg] = segment_rect(style, seg);
+
+        for (uint8_t dot = 0; dot < 2; ++dot)
+            dots_[dot] = colon_rect(style, dot);
+    }
+
+    const style_t&
+    style() const noexcept
+    {
+        return style_;
+    }
+
+    /**
+     * Draw text with its top left corner at (x, y).
+     */
+    void
+    draw(Adafruit_GFX* gfx, int16_t x, int16_t y, const char* text, uint16_t color) noexcept
+    {
+        state_t& prev = state_[frame::back_buffer()];
+
+        size_t len = strnlen(text, N);
+        uint16_t width = text_width(style_, text);
+
+        // Anything that moves things around needs a clean slate
+        bool full = frame::needs_full_redraw() || !prev.valid || prev.x != x
+                    || prev.y != y || prev.len != len || prev.color != color;
+
+        if (full) {
+            if (prev.valid && !frame::needs_full_redraw())
+                gfx->fillRect(prev.x, prev.y, prev.width, style_.height, 0);
+
+            gfx->fillRect(x, y, width, style_.height, 0);
+        }
+
+        int16_t glyph_x = x;
+        for (size_t i = 0; i < len; ++i) {
+            uint8_t mask = glyph_mask(text[i]);
+            uint8_t old = full ? 0 : prev.masks[i];
+
+            if (mask != old) {
+                const rect_t* rects = text[i] == ':' ? dots_ : segments_;
+                uint8_t count = text[i] == ':' ? 2 : SEGMENT_COUNT;
+
+                for (uint8_t seg = 0; seg < count; ++seg) {
+                    uint8_t bit = 1 << seg;
+                    if ((mask ^ old) & bit) {
+                        const rect_t& r = rects[seg];
+                        gfx->fillRect(
+                            glyph_x + r.x, y + r.y, r.w, r.h, (mask & bit) ? color : 0
+                        );
+                    }
+                }
+            }
+
+            prev.masks[i] = mask;
+            glyph_x += glyph_width(style_, text[i]) + style_.spacing;
+        }
+
+        prev.valid = true;
+        prev.x = x;
+        prev.y = y;
+        prev.width = width;
+        prev.len = len;
+        prev.color = color;
+    }
+
+private:
+    struct state_t {
+        bool valid;
+        int16_t x, y;
+        uint16_t width;
+        uint8_t len;
+        uint16_t color;
+        uint8_t masks[N];
+    };
+
+    style_t style_;
+    rect_t segments_[SEGMENT_COUNT];
+    rect_t dots_[2];
+
+    state_t state_[frame::BUFFER_COUNT]{};
+};
+
+} // namespace seven_seg
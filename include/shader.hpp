@@ -0,0 +1,110 @@
+#pragma once
+
+#include "geometry.hpp"
+
+#include <Arduino.h>
+#include <Adafruit_GFX.h>
+
+/**
+ * Colors for everything renderers draw.
+ *
+ * Flat shaders (a single color, the time-of-day hue, the pomodoro palette) just
+ * produce the color renderers are given. Gradients need a color per pixel:
+ * renderers draw in `INK` through a `painter`, which swaps it for the
+ * gradient's color from its per-column or per-row table, built when the shader
+ * changes. All color math is 8-bit fixed point through a 256-entry level LUT.
+ *
+ * The panel library already applies CIE1931 lightness correction, so there is
+ * no gamma here; interpolating 8-bit channels is already perceptually even.
+ */
+namespace shader {
+
+enum kind_t : uint8_t {
+    SHADER_FLAT,        // display/color
+    SHADER_H_GRADIENT,  // left to right
+    SHADER_V_GRADIENT,  // top to bottom
+    SHADER_TIME_OF_DAY, // hue follows the time, dimmed at night
+    SHADER_POMODORO,    // a color per pomodoro mode
+};
+
+/**
+ * What renderers draw in under a gradient. Anything but black is ink.
+ */
+constexpr uint16_t INK = 0xffff;
+
+/**
+ * Pack 8-bit channels into RGB565 through the level LUT.
+ */
+uint16_t rgb565(uint8_t r, uint8_t g, uint8_t b) noexcept;
+
+/**
+ * Set the shader from a display/shader message:
+ *
+ *  flat | hgrad <rrggbb> <rrggbb> | vgrad <rrggbb> <rrggbb> | hue | pomodoro
+ *
+ * Safe to call from the MQTT task, it takes effect at the next `apply()`.
+ */
+void on_mqtt_message(const String& payload) noexcept;
+
+/**
+ * Pick up a new shader. Call between frames.
+ *
+ * @returns whether it changed, i.e. whether everything needs a redraw.
+ */
+bool apply() noexcept;
+
+/**
+ * Color to draw with this frame.
+ *
+ * @param flat_color The display/color setting.
+ * @param local_time Local time of the frame.
+ * @param pomodoro_mode See `pomodoro::current_mode()`.
+ */
+uint16_t color(uint16_t flat_color, time_t local_time, int8_t pomodoro_mode) noexcept;
+
+/**
+ * Where to draw this frame: a `painter` over `display` for gradients, `display`
+ * itself otherwise.
+ */
+Adafruit_GFX* target(Adafruit_GFX* display) noexcept;
+
+/**
+ * Draws onto another GFX target, replacing ink with the gradient's colors.
+ *
+ * Fills become one line per column (or row) of the gradient, so they stay on
+ * the target's fast line paths.
+ */
+class painter : public Adafruit_GFX {
+public:
+    painter(kind_t kind) noexcept;
+
+    void
+    set_target(Adafruit_GFX* target) noexcept
+    {
+        target_ = target;
+    }
+
+    /**
+     * Build the gradient's colors, RGB888 at either end.
+     */
+    void set_gradient(uint32_t from, uint32_t to) noexcept;
+
+    void drawPixel(int16_t x, int16_t y, uint16_t color) override;
+    void drawFastHLine(int16_t x, int16_t y, int16_t w, uint16_t color) override;
+    void drawFastVLine(int16_t x, int16_t y, int16_t h, uint16_t color) override;
+    void fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) override;
+    void fillScreen(uint16_t color) override;
+
+private:
+    static constexpr int16_t LEN = panel_geometry::width > panel_geometry::height
+                                       ? panel_geometry::width
+                                       : panel_geometry::height;
+
+    kind_t kind_;
+    Adafruit_GFX* target_ = nullptr;
+
+    // Per column for a horizontal gradient, per row for a vertical one
+    uint16_t colors_[LEN]{};
+};
+
+} // namespace shader
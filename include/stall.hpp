@@ -0,0 +1,88 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <iterator>
+
+/**
+ * Loop stall monitor.
+ *
+ * `loop()` marks the start of each of its phases. Every iteration that is busy
+ * for longer than the budget is blamed on the phase it spent the most time in and
+ * remembered in a ring buffer. Iteration times go into a histogram that is
+ * published to display/stats/stall every minute.
+ *
+ * The ring buffer and the phase in progress live in RTC memory, so after a
+ * watchdog reset the next boot can tell where the last one got stuck.
+ */
+namespace stall {
+
+enum phase_t : uint8_t {
+    PHASE_CONNECT,      // WiFi and MQTT reconnects
+    PHASE_HOUSEKEEPING, // OTA, history, settings and stats
+    PHASE_CONSOLE,
+    PHASE_TIMEZONE, // timezone and NTP requests
+    PHASE_EZTIME,   // applying syncs and ezTime events
+    PHASE_RENDER,
+    PHASE_FLIP,
+    PHASE_IDLE, // waiting for work, not counted
+    //
+    PHASE_LAST,
+};
+
+/**
+ * Upper bounds of the iteration time histogram buckets, the last bucket takes
+ * the rest.
+ */
+constexpr uint32_t BUCKET_MS[] = {1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000};
+constexpr uint8_t BUCKET_COUNT = std::size(BUCKET_MS) + 1;
+
+struct stats_t {
+    uint32_t iterations;
+    int64_t total_us;
+    uint32_t max_us;
+    uint32_t buckets[BUCKET_COUNT];
+    uint32_t stalls[PHASE_LAST]; // by culprit
+};
+
+/**
+ * Pick up what the last boot left behind. Call first thing in `setup()`.
+ */
+void begin() noexcept;
+
+/**
+ * Close the previous iteration and start a new one in `PHASE_CONNECT`. Call
+ * first thing in `loop()`, so iterations that return early are counted too.
+ */
+void loop_started() noexcept;
+
+/**
+ * Mark the start of a phase, ending the current one.
+ */
+void enter(phase_t phase) noexcept;
+
+/**
+ * Get the name of a phase.
+ */
+const char* phase_name(phase_t phase) noexcept;
+
+/**
+ * Set the budget an iteration may take before it counts as a stall.
+ */
+void set_budget(uint32_t budget_ms) noexcept;
+
+/**
+ * Publish the histogram once a minute. Call from the main loop.
+ */
+void poll() noexcept;
+
+/**
+ * Print the histogram and recent stalls, including the last boot's.
+ */
+void print_status() noexcept;
+
+stats_t stats() noexcept;
+
+void reset_stats() noexcept;
+
+} // namespace stall
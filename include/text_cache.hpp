@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * The bookkeeping behind `text_layout`: keys, lookups and eviction. Measuring
+ * the text is left to the caller, so this runs on the host in the native tests.
+ */
+namespace text_layout {
+
+constexpr size_t CAPACITY = 8;
+
+struct entry_t {
+    uint32_t hash;
+    uint16_t length;
+    uint16_t style; // font + size, see set_style()
+    uint16_t area_width;
+
+    int16_t cursor_x; // centered within area_width
+    uint16_t w, h;
+
+    uint32_t used; // when last looked up, 0 if the entry is empty
+};
+
+struct stats_t {
+    uint32_t hits;
+    uint32_t misses;
+};
+
+struct cache_t {
+    entry_t entries[CAPACITY];
+    uint32_t clock; // bumped on every lookup
+    stats_t counters;
+};
+
+/**
+ * Hash a string the same way the cache does.
+ */
+inline uint32_t
+hash(const char* text, uint16_t* length = nullptr) noexcept
+{
+    // FNV-1a
+    uint32_t value = 2166136261u;
+    uint16_t len = 0;
+
+    for (const char* c = text; *c; ++c, ++len) {
+        value ^= static_cast<uint8_t>(*c);
+        value *= 16777619u;
+    }
+
+    if (length)
+        *length = len;
+
+    return value;
+}
+
+/**
+ * Find a measurement, counting the hit or miss.
+ *
+ * @returns the entry, or nullptr if the text has to be measured and `insert`ed.
+ */
+inline const entry_t*
+lookup(
+    cache_t* cache, uint32_t hash, uint16_t length, uint16_t style, uint16_t area_width
+) noexcept
+{
+    // Every ~4 billion lookups the clock wraps, start the ages over
+    if (++cache->clock == 0) {
+        for (entry_t& entry : cache->entries)
+            entry.used = entry.used ? 1 : 0;
+        cache->clock = 1;
+    }
+
+    for (entry_t& entry : cache->entries) {
+        if (entry.used && entry.hash == hash && entry.length == length
+            && entry.style == style && entry.area_width == area_width) {
+            entry.used = cache->clock;
+            ++cache->counters.hits;
+            return &entry;
+        }
+    }
+
+    ++cache->counters.misses;
+    return nullptr;
+}
+
+/**
+ * Remember a measurement that `lookup` missed, in place of the least recently
+ * used one. The strings drawn every frame stay put however many one-off strings
+ * go through.
+ */
+inline const entry_t&
+insert(
+    cache_t* cache,
+    uint32_t hash,
+    uint16_t length,
+    uint16_t style,
+    uint16_t area_width,
+    uint16_t w,
+    uint16_t h
+) noexcept
+{
+    // Empty entries have `used` 0, so they go first
+    entry_t* victim = &cache->entries[0];
+    for (entry_t& entry : cache->entries) {
+        if (entry.used < victim->used)
+            victim = &entry;
+    }
+
+    victim->hash = hash;
+    victim->length = length;
+    victim->style = style;
+    victim->area_width = area_width;
+
+    victim->cursor_x = (static_cast<int16_t>(area_width) - static_cast<int16_t>(w)) / 2;
+    victim->w = w;
+    victim->h = h;
+    victim->used = cache->clock;
+
+    return *victim;
+}
+
+} // namespace text_layout
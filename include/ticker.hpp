@@ -0,0 +1,58 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <Adafruit_GFX.h>
+
+/**
+ * Scrolling notifications.
+ *
+ * Messages from display/ticker are queued and shown one at a time. Each is
+ * rasterized once into a 1-bit strip, then every frame only copies the visible
+ * window of the strip onto the display, so text never goes through GFX while
+ * scrolling.
+ */
+namespace ticker {
+
+/**
+ * Longest message shown, anything past this is cut off.
+ */
+constexpr size_t MAX_LEN = 96;
+
+/**
+ * Frame rate while scrolling. Text moves one (scaled) pixel per frame.
+ */
+constexpr uint16_t FPS = 50;
+
+/**
+ * Create the message queue.
+ */
+void begin() noexcept;
+
+/**
+ * Queue a message. Safe to call from the MQTT task.
+ */
+void push(const uint8_t* text, size_t length) noexcept;
+
+/**
+ * Whether a message is being shown or waiting to be.
+ */
+bool is_active() noexcept;
+
+/**
+ * Draw the ticker as of `at_us` (`esp_timer_get_time()` time). A `snapshot`
+ * only shows the current message, it never starts or finishes one.
+ *
+ * Instantiated in ticker.cpp for `panel_geometry`.
+ */
+template <typename G>
+void draw(Adafruit_GFX* gfx, int64_t at_us, uint16_t color, bool snapshot);
+
+/**
+ * Print frame rate, frame time and queue depth.
+ */
+void print_status() noexcept;
+
+void reset_stats() noexcept;
+
+} // namespace ticker
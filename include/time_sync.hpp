@@ -0,0 +1,51 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ezTime.h>
+
+/**
+ * NTP and timezone lookups on a background task.
+ *
+ * Both block on UDP round trips for up to several seconds, so the main loop only
+ * queues requests and picks up finished results, never waiting on the network.
+ * Requests that fail, or arrive while WiFi is down, are retried with backoff
+ * (2 s doubling up to a minute) until they succeed.
+ */
+namespace time_sync {
+
+/**
+ * Start the sync task. NTP is synced periodically from then on.
+ */
+void begin() noexcept;
+
+/**
+ * Ask for an NTP sync.
+ */
+void request_ntp() noexcept;
+
+/**
+ * Ask for the rules of a timezone, e.g. "America/Chicago".
+ */
+void request_timezone(const char* location) noexcept;
+
+/**
+ * Feed finished NTP syncs to `timebase` and apply timezones to `tz`. Never blocks.
+ */
+void apply(Timezone* tz) noexcept;
+
+/**
+ * Longest lookup so far, i.e. the worst stall the loop would have had.
+ */
+uint32_t worst_stall_ms() noexcept;
+
+/**
+ * Print sync stats.
+ */
+void print_status() noexcept;
+
+/**
+ * Reset sync stats.
+ */
+void reset_stats() noexcept;
+
+} // namespace time_sync
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <Arduino.h>
+
+/**
+ * Wall clock disciplined by NTP.
+ *
+ * Wall time is a linear mapping of `esp_timer_get_time()`. NTP samples adjust
+ * the mapping instead of replacing it. Small offsets are slewed out by running
+ * the clock slightly fast or slow, so displayed seconds never skip or repeat.
+ * Only large offsets (or the first sample) step it. The crystal's drift is
+ * estimated from what is left over at each sample and corrected continuously.
+ */
+namespace timebase {
+
+struct metrics_t {
+    bool is_set;
+    bool slewing;
+    int32_t offset_ms;       // measured at the last sample
+    int32_t slew_left_ms;    // still to be slewed out
+    int32_t drift_ppb;       // correction applied for the crystal
+    uint32_t samples;
+    uint32_t steps;
+};
+
+/**
+ * Feed an NTP sample: UTC second `time` began at `mono_us` (`esp_timer_get_time()`).
+ */
+void on_sample(time_t time, int64_t mono_us) noexcept;
+
+/**
+ * Whether there has been a sample yet.
+ */
+bool is_set() noexcept;
+
+/**
+ * UTC wall time at `mono_us`, in microseconds since the epoch.
+ */
+int64_t wall_us(int64_t mono_us) noexcept;
+
+/**
+ * Current UTC time in milliseconds since the epoch.
+ */
+int64_t now_ms() noexcept;
+
+/**
+ * Current UTC time.
+ */
+time_t now() noexcept;
+
+metrics_t metrics() noexcept;
+
+/**
+ * Print discipline state and publish it to MQTT.
+ */
+void print_status() noexcept;
+void publish() noexcept;
+
+} // namespace timebase
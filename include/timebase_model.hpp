@@ -0,0 +1,124 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+
+/**
+ * The clock discipline behind `timebase`, as plain functions of the samples fed
+ * to it. Nothing here reads a clock or takes a lock, so it runs on the host in
+ * the native tests.
+ */
+namespace timebase {
+
+constexpr int64_t BILLION = 1000 * 1000 * 1000;
+
+constexpr int64_t STEP_THRESHOLD_US = 1000 * 1000; // larger offsets are stepped
+constexpr int64_t SLEW_PPB = 500 * 1000;           // 0.5 ms per second, like adjtime()
+constexpr int64_t MAX_DRIFT_PPB = 200 * 1000;      // way past any sane crystal
+
+// Samples closer together than this can't tell drift from network jitter
+constexpr int64_t MIN_DRIFT_INTERVAL_US = 5 * 60 * 1000000LL;
+
+/**
+ * wall = base_wall + dt + dt * drift + min(dt, slew length) * slew
+ */
+struct model_t {
+    int64_t base_mono_us;
+    int64_t base_wall_us;
+    int64_t drift_ppb;
+    int64_t slew_ppb;
+    int64_t slew_end_us; // mono time the slew is done
+};
+
+/**
+ * A model and what it has learned from the samples so far.
+ */
+struct discipline_t {
+    model_t model;
+    bool is_set;
+
+    int64_t last_sample_us;
+    int64_t last_offset_us;
+    uint32_t samples;
+    uint32_t steps;
+};
+
+/**
+ * Wall time the model gives at `mono_us`, in microseconds since the epoch.
+ */
+inline int64_t
+wall_at(const model_t& m, int64_t mono_us) noexcept
+{
+    int64_t dt = mono_us - m.base_mono_us;
+    int64_t slewed = std::min(dt, m.slew_end_us - m.base_mono_us);
+
+    return m.base_wall_us + dt + dt * m.drift_ppb / BILLION + slewed * m.slew_ppb / BILLION;
+}
+
+/**
+ * Offset still to be slewed out after `mono_us`.
+ */
+inline int64_t
+slew_left_at(const model_t& m, int64_t mono_us) noexcept
+{
+    int64_t left = m.slew_end_us - std::max(mono_us, m.base_mono_us);
+    return left > 0 ? left * m.slew_ppb / BILLION : 0;
+}
+
+/**
+ * Move the model's base to `mono_us` without changing the time it gives there.
+ */
+inline void
+rebase(model_t* m, int64_t mono_us) noexcept
+{
+    int64_t left_us = m->slew_end_us - mono_us;
+
+    m->base_wall_us = wall_at(*m, mono_us);
+    m->base_mono_us = mono_us;
+    m->slew_end_us = mono_us + std::max(left_us, static_cast<int64_t>(0));
+}
+
+/**
+ * Feed a sample: UTC second `time` began at `mono_us`.
+ */
+inline void
+apply_sample(discipline_t* d, int64_t time, int64_t mono_us) noexcept
+{
+    model_t& m = d->model;
+    int64_t offset_us = d->is_set ? time * 1000000 - wall_at(m, mono_us) : 0;
+
+    if (!d->is_set || std::abs(offset_us) > STEP_THRESHOLD_US) {
+        m.base_mono_us = mono_us;
+        m.base_wall_us = time * 1000000;
+        m.slew_ppb = 0;
+        m.slew_end_us = mono_us;
+
+        ++d->steps;
+    }
+    else {
+        int64_t residual_us = offset_us - slew_left_at(m, mono_us);
+
+        // The new drift and slew only apply from here on, so nothing jumps
+        rebase(&m, mono_us);
+
+        // Whatever the last slew wasn't going to fix is the crystal drifting
+        int64_t interval_us = mono_us - d->last_sample_us;
+
+        if (interval_us >= MIN_DRIFT_INTERVAL_US) {
+            // Only take a quarter of it, a single sample is mostly network jitter
+            m.drift_ppb += residual_us * BILLION / interval_us / 4;
+            m.drift_ppb = std::clamp(m.drift_ppb, -MAX_DRIFT_PPB, MAX_DRIFT_PPB);
+        }
+
+        m.slew_ppb = offset_us > 0 ? SLEW_PPB : -SLEW_PPB;
+        m.slew_end_us = mono_us + std::abs(offset_us) * BILLION / SLEW_PPB;
+    }
+
+    d->is_set = true;
+    d->last_sample_us = mono_us;
+    d->last_offset_us = offset_us;
+    ++d->samples;
+}
+
+} // namespace timebase
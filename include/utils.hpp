@@ -2,7 +2,9 @@
 
 #include <Arduino.h>
 
-#include <ESP32-HUB75-MatrixPanel-I2S-DMA.h>
+#include <Adafruit_GFX.h>
+
+#include "text_cache.hpp"
 
 // espressif/arduino-esp32 - examples/ResetReason/ResetReason.ino
 #ifdef ESP_IDF_VERSION_MAJOR  // IDF 4+
@@ -54,12 +56,62 @@ const char* get_reset_reason(int core) noexcept;
 void print_chip_debug_info() noexcept;
 
 /**
- * Print text centered on an LED matrix display.
+ * Memoized text measurements.
+ *
+ * `getTextBounds` walks every glyph of a string just to find its width, and most
+ * of what we draw is the same from frame to frame. Measurements are cached by
+ * string hash, font and text size, see text_cache.hpp.
+ */
+namespace text_layout {
+
+/**
+ * Set the font and text size of a display.
+ *
+ * Always go through this rather than `setFont`/`setTextSize`, the cache is keyed
+ * on the style set here.
+ */
+void set_style(Adafruit_GFX* gfx, const GFXfont* font, uint8_t size) noexcept;
+
+/**
+ * Measure text, using the cache if possible.
+ *
+ * @param area_width Width of the area the text is centered in.
+ */
+const entry_t& measure(
+    const char* text, uint16_t area_width, Adafruit_GFX* gfx
+) noexcept;
+
+/**
+ * Get the cache hit/miss counters.
+ */
+stats_t stats() noexcept;
+
+/**
+ * Reset the cache hit/miss counters.
+ */
+void reset_stats() noexcept;
+
+} // namespace text_layout
+
+/**
+ * Print text horizontally centered on an LED matrix display.
+ *
+ * The centering area comes from the compile-time geometry `G`, and text bounds
+ * come from the layout cache.
  */
-void print_centered(const char* text, uint16_t cursor_y, MatrixPanel_I2S_DMA* display);
+template <typename G>
+void
+print_centered(const char* text, int16_t cursor_y, Adafruit_GFX* gfx)
+{
+    const text_layout::entry_t& layout = text_layout::measure(text, G::width, gfx);
+
+    gfx->setCursor(layout.cursor_x, cursor_y);
+    gfx->print(text);
+}
 
+template <typename G>
 inline void
-print_centered(const String& text, uint16_t cursor_y, MatrixPanel_I2S_DMA* display)
+print_centered(const String& text, int16_t cursor_y, Adafruit_GFX* gfx)
 {
-    print_centered(text.c_str(), cursor_y, display);
+    print_centered<G>(text.c_str(), cursor_y, gfx);
 }
@@ -0,0 +1,88 @@
+"""
+Stream a firmware image to the displays over MQTT.
+
+Usage: OTA_KEY=<key> python scripts/ota_upload.py <broker> <firmware.bin> [chunk size]
+
+Chunks are sent one at a time and resent from wherever the device says it is,
+so an interrupted upload picks up where it left off. The image's hash is signed
+with OTA_KEY, which has to match the one in the displays' config.h.
+"""
+
+import hashlib
+import hmac
+import os
+import struct
+import sys
+import threading
+import time
+
+import paho.mqtt.client as mqtt
+
+TOPIC_BEGIN = "display/ota/begin"
+TOPIC_CHUNK = "display/ota/chunk"
+TOPIC_STATUS = "display/ota/status"
+
+ACK_TIMEOUT_S = 5
+MAX_UNANSWERED_BEGINS = 3  # begins signed with the wrong key get no answer
+MAX_CHUNK_LEN = 2048 - 4  # mqtt::MAX_MESSAGE_LEN minus the sequence number
+
+
+def main():
+    broker, path = sys.argv[1], sys.argv[2]
+    chunk_len = int(sys.argv[3]) if len(sys.argv) > 3 else 1024
+    assert 0 < chunk_len <= MAX_CHUNK_LEN
+
+    key = os.environ.get("OTA_KEY")
+    if not key:
+        sys.exit("Set OTA_KEY to the key in config.h")
+
+    image = open(path, "rb").read()
+    digest = hashlib.sha256(image).digest()
+    sha = digest.hex()
+    mac = hmac.new(key.encode(), digest, hashlib.sha256).hexdigest()
+    chunks = [image[i : i + chunk_len] for i in range(0, len(image), chunk_len)]
+
+    status = {"state": None, "seq": 0}
+    acked = threading.Event()
+
+    def on_message(client, userdata, msg):
+        state, seq, written, kbps = msg.payload.decode().split()
+        status.update(state=state, seq=int(seq))
+        print(f"\r{state}: {written}/{len(image)} bytes, {kbps} KB/s", end="")
+        acked.set()
+
+    client = mqtt.Client()
+    client.on_message = on_message
+    client.connect(broker)
+    client.subscribe(TOPIC_STATUS, 0)
+    client.loop_start()
+
+    def send(topic, payload):
+        acked.clear()
+        client.publish(topic, payload, qos=1)
+        return acked.wait(ACK_TIMEOUT_S)
+
+    start = time.monotonic()
+    unanswered = 0
+    while status["state"] != "done":
+        if status["state"] != "receiving":
+            unanswered = 0 if send(TOPIC_BEGIN, f"{len(image)} {sha} {mac}") else unanswered + 1
+            if unanswered == MAX_UNANSWERED_BEGINS:
+                sys.exit("No answer from the display, check OTA_KEY")
+        elif status["seq"] < len(chunks):
+            seq = status["seq"]
+            send(TOPIC_CHUNK, struct.pack("<I", seq) + chunks[seq])
+        else:
+            acked.clear()
+            acked.wait(ACK_TIMEOUT_S)
+
+        if status["state"] == "failed":
+            sys.exit("\nUpdate failed")
+
+    elapsed = time.monotonic() - start
+    print(f"\nSent {len(image)} bytes in {elapsed:.1f} s ({len(image) / 1024 / elapsed:.1f} KB/s)")
+    client.loop_stop()
+
+
+if __name__ == "__main__":
+    main()
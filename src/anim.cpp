@@ -0,0 +1,270 @@
+#include "anim.hpp"
+
+#include "frame.hpp"
+#include "geometry.hpp"
+
+#include <esp_timer.h>
+
+namespace {
+
+constexpr int16_t W = panel_geometry::width;
+constexpr int16_t H = panel_geometry::height;
+
+constexpr int64_t PULSE_PERIOD_US = 1000 * 1000;
+constexpr uint16_t PULSE_PEAK = 160; // out of 256
+
+constexpr uint16_t WHITE = 0xffff;
+
+struct effect_t {
+    bool running;
+    int64_t start_us;
+    int64_t end_us;
+
+    /**
+     * How far along the effect is at `at_us`, 0..256.
+     */
+    uint16_t
+    progress(int64_t at_us) const
+    {
+        return (at_us - start_us) * 256 / (end_us - start_us);
+    }
+};
+
+enum composite_t : uint8_t {
+    COMPOSITE_NONE,
+    COMPOSITE_CROSSFADE,
+    COMPOSITE_PULSE,
+};
+
+effect_t crossfade{};
+effect_t pulse{};
+uint32_t pending_pulse_ms = 0;
+
+// Brightness ramp
+effect_t ramp{};
+bool ramp_set = false;
+uint8_t ramp_from = 0;
+uint8_t ramp_to = 0;
+
+// This frame
+composite_t composite = COMPOSITE_NONE;
+uint16_t alpha = 0; // of the incoming frame
+
+GFXcanvas16* outgoing_canvas = nullptr;
+GFXcanvas16* incoming_canvas = nullptr;
+
+// Scaled channels, built for each frame's alpha
+uint8_t in5[32], out5[32];
+uint8_t in6[64], out6[64];
+
+// Stats
+uint32_t crossfades = 0;
+uint32_t pulses = 0;
+uint32_t ramps = 0;
+uint32_t composited = 0;
+uint32_t max_composite_us = 0;
+uint64_t total_composite_us = 0;
+
+GFXcanvas16*
+make_canvas()
+{
+    GFXcanvas16* canvas = new GFXcanvas16(W, H);
+    canvas->cp437(true); // like the display, see setup_led_matrix()
+
+    return canvas;
+}
+
+void
+build_tables(uint16_t a)
+{
+    for (uint8_t v = 0; v < 32; ++v) {
+        in5[v] = v * a >> 8;
+        out5[v] = v * (256 - a) >> 8;
+    }
+
+    for (uint8_t v = 0; v < 64; ++v) {
+        in6[v] = v * a >> 8;
+        out6[v] = v * (256 - a) >> 8;
+    }
+}
+
+uint16_t
+blend(uint16_t in, uint16_t out)
+{
+    uint16_t r = in5[in >> 11] + out5[out >> 11];
+    uint16_t g = in6[(in >> 5) & 0x3f] + out6[(out >> 5) & 0x3f];
+    uint16_t b = in5[in & 0x1f] + out5[out & 0x1f];
+
+    return (r << 11) | (g << 5) | b;
+}
+
+/**
+ * Whether `effect` still runs for the frame at `at_us`, stopping it if not.
+ */
+bool
+still_running(effect_t& effect, int64_t at_us)
+{
+    if (effect.running && at_us >= effect.end_us)
+        effect.running = false;
+
+    return effect.running;
+}
+
+} // namespace
+
+namespace anim {
+
+bool
+active() noexcept
+{
+    return crossfade.running || pulse.running || pending_pulse_ms || ramp.running;
+}
+
+Adafruit_GFX*
+outgoing() noexcept
+{
+    if (!outgoing_canvas)
+        outgoing_canvas = make_canvas();
+
+    outgoing_canvas->fillScreen(0);
+    return outgoing_canvas;
+}
+
+void
+start_crossfade(int64_t at_us) noexcept
+{
+    crossfade = {true, at_us, at_us + CROSSFADE_MS * 1000};
+    ++crossfades;
+}
+
+void
+start_pulse(uint32_t duration_ms) noexcept
+{
+    pending_pulse_ms = duration_ms;
+    ++pulses;
+}
+
+uint8_t
+brightness(uint8_t target, int64_t at_us) noexcept
+{
+    if (!ramp_set) {
+        ramp_from = ramp_to = target;
+        ramp_set = true;
+    }
+
+    // Ramp from wherever we are now
+    if (target != ramp_to) {
+        ramp_from = brightness(ramp_to, at_us);
+        ramp_to = target;
+
+        ramp = {true, at_us, at_us + RAMP_MS * 1000};
+        ++ramps;
+    }
+
+    if (!still_running(ramp, at_us))
+        return ramp_to;
+
+    return ramp_from + ((ramp_to - ramp_from) * ramp.progress(at_us) >> 8);
+}
+
+Adafruit_GFX*
+target(Adafruit_GFX* display, int64_t at_us) noexcept
+{
+    if (pending_pulse_ms) {
+        pulse = {true, at_us, at_us + pending_pulse_ms * 1000LL};
+        pending_pulse_ms = 0;
+    }
+
+    composite_t prev = composite;
+    composite = COMPOSITE_NONE;
+
+    if (still_running(crossfade, at_us)) {
+        composite = COMPOSITE_CROSSFADE;
+        alpha = crossfade.progress(at_us);
+    }
+    else if (still_running(pulse, at_us)) {
+        // Triangle wave, fading in and out once a period
+        int64_t phase_us = (at_us - pulse.start_us) % PULSE_PERIOD_US;
+        int64_t half_us = PULSE_PERIOD_US / 2;
+        int64_t level_us = phase_us < half_us ? phase_us : PULSE_PERIOD_US - phase_us;
+
+        composite = COMPOSITE_PULSE;
+        alpha = 256 - level_us * PULSE_PEAK / half_us;
+    }
+
+    if (composite == COMPOSITE_NONE) {
+        // The display holds a blend, nothing the renderers drew
+        if (prev != COMPOSITE_NONE)
+            frame::invalidate();
+
+        return display;
+    }
+
+    if (!incoming_canvas)
+        incoming_canvas = make_canvas();
+
+    // The canvas is shared by both buffers, so draw all of it every time
+    frame::invalidate();
+    return incoming_canvas;
+}
+
+void
+finish(Adafruit_GFX* display) noexcept
+{
+    if (composite == COMPOSITE_NONE)
+        return;
+
+    int64_t started_us = esp_timer_get_time();
+
+    build_tables(alpha);
+
+    const uint16_t* in = incoming_canvas->getBuffer();
+    const uint16_t* out = composite == COMPOSITE_CROSSFADE ? outgoing_canvas->getBuffer()
+                                                           : nullptr;
+
+    for (int16_t y = 0; y < H; ++y) {
+        for (int16_t x = 0; x < W; ++x) {
+            size_t i = static_cast<size_t>(y) * W + x;
+            display->drawPixel(x, y, blend(in[i], out ? out[i] : WHITE));
+        }
+    }
+
+    uint32_t composite_us = esp_timer_get_time() - started_us;
+
+    ++composited;
+    total_composite_us += composite_us;
+    max_composite_us = max(max_composite_us, composite_us);
+}
+
+void
+print_status() noexcept
+{
+    log_i(
+        "Animations: %lu crossfades, %lu pulses, %lu brightness ramps, %s",
+        crossfades,
+        pulses,
+        ramps,
+        active() ? "animating" : "idle"
+    );
+
+    log_i(
+        "Composited %lu frames, avg %lu us, max %lu us, %lu frames dropped",
+        composited,
+        composited ? static_cast<uint32_t>(total_composite_us / composited) : 0,
+        max_composite_us,
+        frame::flip_stats().dropped
+    );
+}
+
+void
+reset_stats() noexcept
+{
+    crossfades = 0;
+    pulses = 0;
+    ramps = 0;
+    composited = 0;
+    max_composite_us = 0;
+    total_composite_us = 0;
+}
+
+} // namespace anim
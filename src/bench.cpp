@@ -0,0 +1,254 @@
+#include "bench.hpp"
+
+#include "clock.hpp"
+#include "console.hpp"
+#include "frame.hpp"
+#include "geometry.hpp"
+#include "modes.hpp"
+#include "pomodoro.hpp"
+#include "settings.hpp"
+#include "shader.hpp"
+#include "timebase.hpp"
+#include "utils.hpp"
+
+#include <esp_timer.h>
+
+#include <algorithm>
+
+namespace {
+
+constexpr uint32_t MAX_ITERATIONS = 1000;
+constexpr uint32_t DEFAULT_ITERATIONS = 100;
+
+MatrixPanel_I2S_DMA* display = nullptr;
+Timezone* local_tz = nullptr;
+const uint16_t* color = nullptr;
+
+uint32_t samples[MAX_ITERATIONS];
+
+/**
+ * Time `fn` and print a summary.
+ */
+template <typename F>
+void
+run(const char* name, uint32_t iterations, F&& fn)
+{
+    for (uint32_t i = 0; i < iterations; ++i) {
+        int64_t started_us = esp_timer_get_time();
+        fn();
+        samples[i] = esp_timer_get_time() - started_us;
+    }
+
+    std::sort(samples, samples + iterations);
+
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < iterations; ++i)
+        total += samples[i];
+
+    log_i(
+        "%s: %lu runs, min %lu us, avg %lu us, p99 %lu us, max %lu us",
+        name,
+        iterations,
+        samples[0],
+        static_cast<uint32_t>(total / iterations),
+        samples[iterations * 99 / 100],
+        samples[iterations - 1]
+    );
+
+    // What we drew doesn't match what the renderers think is there
+    frame::invalidate();
+    frame::forget_panel();
+}
+
+uint32_t
+parse_iterations(int argc, char** argv, int index)
+{
+    if (argc <= index)
+        return DEFAULT_ITERATIONS;
+
+    long val = strtol(argv[index], NULL, 10);
+    return constrain(val, 1, static_cast<long>(MAX_ITERATIONS));
+}
+
+void
+bench_draw(int argc, char** argv)
+{
+    if (argc < 3) {
+        log_e("Usage: bench draw <clock|pomodoro> [iterations] [full]");
+        return;
+    }
+
+    uint32_t iterations = parse_iterations(argc, argv, 3);
+    bool full = argc > 4 && strcmp(argv[4], "full") == 0;
+
+    // Whatever the render loop draws into, the shadow canvas if single buffered
+    Adafruit_GFX* gfx = frame::target(display);
+
+    if (strcmp(argv[2], "clock") == 0) {
+        run("draw clock", iterations, [gfx, full] {
+            if (full)
+                frame::invalidate();
+
+            matrix_clock::draw<panel_geometry>(gfx, local_tz, timebase::now(), *color);
+        });
+    }
+    else if (strcmp(argv[2], "pomodoro") == 0) {
+        // Drawing would start a session, and publish it to the group
+        if (pomodoro::current_mode() < 0) {
+            log_e("No pomodoro running, show the pomodoro mode first");
+            return;
+        }
+
+        run("draw pomodoro", iterations, [gfx, full] {
+            if (full)
+                frame::invalidate();
+
+            pomodoro::draw<panel_geometry>(gfx, local_tz, timebase::now(), *color, false);
+        });
+    }
+    else {
+        log_e("Unknown draw target %s", argv[2]);
+    }
+}
+
+void
+bench_text(int argc, char** argv)
+{
+    if (argc < 3) {
+        log_e("Usage: bench text <text...>");
+        return;
+    }
+
+    // Put the words back together
+    char text[console::LINE_LEN];
+    size_t len = 0;
+
+    for (int i = 2; i < argc; ++i)
+        len += snprintf(text + len, sizeof(text) - len, i == 2 ? "%s" : " %s", argv[i]);
+
+    run("measure text", MAX_ITERATIONS, [&] {
+        int16_t x, y;
+        uint16_t w, h;
+        display->getTextBounds(text, 0, 0, &x, &y, &w, &h);
+    });
+
+    run("print_centered", MAX_ITERATIONS, [&] {
+        print_centered<panel_geometry>(text, 0, display);
+    });
+}
+
+void
+bench_shade()
+{
+    static shader::painter h_painter(shader::SHADER_H_GRADIENT);
+    static shader::painter v_painter(shader::SHADER_V_GRADIENT);
+
+    // Our own gradients, whatever the display is showing
+    h_painter.set_gradient(0xff0000, 0x0000ff);
+    v_painter.set_gradient(0xff0000, 0x0000ff);
+
+    h_painter.set_target(display);
+    v_painter.set_target(display);
+
+    run("fill flat", MAX_ITERATIONS, [] {
+        display->fillScreen(*color);
+    });
+
+    run("fill hgrad", MAX_ITERATIONS, [] {
+        h_painter.fillScreen(shader::INK);
+    });
+
+    run("fill vgrad", MAX_ITERATIONS, [] {
+        v_painter.fillScreen(shader::INK);
+    });
+
+    // Same text the clock draws
+    display->setTextColor(*color);
+    run("text flat", MAX_ITERATIONS, [] {
+        print_centered<panel_geometry>("12/31/2024", 0, display);
+    });
+
+    h_painter.setTextColor(shader::INK);
+    run("text hgrad", MAX_ITERATIONS, [] {
+        print_centered<panel_geometry>("12/31/2024", 0, &h_painter);
+    });
+
+    v_painter.setTextColor(shader::INK);
+    run("text vgrad", MAX_ITERATIONS, [] {
+        print_centered<panel_geometry>("12/31/2024", 0, &v_painter);
+    });
+}
+
+void
+bench_config()
+{
+    settings::record_t record{};
+    record.fields = settings::ALL_FIELDS;
+    record.mode = 1;
+    record.color[0] = 0xff;
+    record.color[1] = 0x80;
+    record.color[2] = 0x20;
+    record.brightness = 200;
+    record.minutes[0] = 25;
+    record.minutes[1] = 5;
+    record.minutes[2] = 15;
+
+    uint8_t buf[settings::MAX_LEN];
+    size_t len = settings::encode(record, buf, sizeof(buf));
+
+    // Make sure what we time actually round trips
+    settings::record_t decoded;
+    if (!len || !settings::decode(buf, len, modes::COUNT, &decoded)
+        || memcmp(&decoded, &record, sizeof(record)) != 0) {
+        log_e("Config record doesn't round trip");
+        return;
+    }
+
+    run("decode record", MAX_ITERATIONS, [&] {
+        settings::decode(buf, len, modes::COUNT, &decoded);
+    });
+
+    // The same settings as separate messages, the way on_mqtt_message() sees them
+    static const char* const TEXT[] = {"1", "ff8020", "200", "25", "5", "15"};
+
+    run("parse text", MAX_ITERATIONS, [] {
+        for (size_t i = 0; i < std::size(TEXT); ++i) {
+            String payload(TEXT[i]);
+            volatile long val = std::strtol(payload.c_str(), NULL, i == 1 ? 16 : 10);
+            (void)val;
+        }
+    });
+}
+
+void
+command(int argc, char** argv)
+{
+    if (argc >= 2 && strcmp(argv[1], "draw") == 0)
+        bench_draw(argc, argv);
+    else if (argc >= 2 && strcmp(argv[1], "text") == 0)
+        bench_text(argc, argv);
+    else if (argc >= 2 && strcmp(argv[1], "shade") == 0)
+        bench_shade();
+    else if (argc >= 2 && strcmp(argv[1], "config") == 0)
+        bench_config();
+    else
+        log_e("Usage: bench <draw|text|shade|config> ...");
+}
+
+} // namespace
+
+namespace bench {
+
+void
+begin(MatrixPanel_I2S_DMA* panel, Timezone* tz, const uint16_t* text_color) noexcept
+{
+    display = panel;
+    local_tz = tz;
+    color = text_color;
+
+    console::add(
+        "bench", "draw <clock|pomodoro> [n] [full] | text <text...> | shade | config", command
+    );
+}
+
+} // namespace bench
@@ -1,27 +1,59 @@
 #include "clock.hpp"
 
+#include "frame.hpp"
+#include "geometry.hpp"
+#include "seven_seg.hpp"
 #include "utils.hpp"
 
 namespace matrix_clock {
 
+template <typename G>
 void
-draw(MatrixPanel_I2S_DMA* display, Timezone* local_tz)
+draw(Adafruit_GFX* gfx, Timezone* local_tz, time_t now, uint16_t color)
 {
+    // Day and date in the GFX font, time in large digits below
+    constexpr int16_t TEXT_H = 2 * GFX_CHAR_H;
+
+    constexpr seven_seg::style_t TIME_STYLE =
+        seven_seg::fit("23:59:59", G::width - 2, G::height - TEXT_H);
+    constexpr int16_t BLOCK_H = TEXT_H + TIME_STYLE.height;
+
+    constexpr int16_t DAY_Y = G::centered_y(BLOCK_H);
+    constexpr int16_t DATE_Y = DAY_Y + GFX_CHAR_H;
+    constexpr int16_t TIME_Y = DATE_Y + GFX_CHAR_H;
+
+    static_assert(DAY_Y >= 0, "Clock face does not fit on the display");
+
+    static seven_seg::renderer<8> time_digits(TIME_STYLE);
+    static uint32_t drawn_date[frame::BUFFER_COUNT]{}; // hash of date and color
+
     log_i("Drawing clock on display");
 
     // Get our time strings
-    String day = local_tz->dateTime("l");
-    String date = local_tz->dateTime("n/j/Y");
-    String time = local_tz->dateTime("G:i:s");
-
-    // Update display
-    display->clearScreen();
-
-    print_centered(day, 2, display);
-    display->print("\n");
-    print_centered(date, display->getCursorY() + 1, display);
-    display->print("\n");
-    print_centered(time, display->getCursorY() + 3, display);
+    String day = local_tz->dateTime(now, UTC_TIME, "l");
+    String date = local_tz->dateTime(now, UTC_TIME, "n/j/Y");
+    String time = local_tz->dateTime(now, UTC_TIME, "G:i:s");
+
+    // Update display, only touching what changed
+    if (frame::needs_full_redraw())
+        gfx->fillScreen(0);
+
+    uint32_t& drawn = drawn_date[frame::back_buffer()];
+    uint32_t date_hash = text_layout::hash(date.c_str()) ^ color;
+
+    if (frame::needs_full_redraw() || drawn != date_hash) {
+        gfx->fillRect(0, DAY_Y, G::width, TEXT_H, 0);
+
+        print_centered<G>(day, DAY_Y, gfx);
+        print_centered<G>(date, DATE_Y, gfx);
+
+        drawn = date_hash;
+    }
+
+    int16_t time_x = G::centered_x(seven_seg::text_width(TIME_STYLE, time.c_str()));
+    time_digits.draw(gfx, time_x, TIME_Y, time.c_str(), color);
 }
 
+template void draw<panel_geometry>(Adafruit_GFX*, Timezone*, time_t, uint16_t);
+
 } // namespace matrix_clock
@@ -3,6 +3,7 @@
 #include "AsyncMqttClient/DisconnectReasons.hpp"
 #include "AsyncMqttClient/MessageProperties.hpp"
 #include "config.h"
+#include "idle.hpp"
 #include "IPAddress.h"
 #include "sys/_stdint.h"
 
@@ -34,6 +35,9 @@ on_event(arduino_event_id_t event)
             *should_reconnect_wifi = false;
 
             xTimerStart(mqtt_reconnect_timer, 0);
+
+            // Timezones can be refreshed now
+            idle::wake();
             break;
 
         case ARDUINO_EVENT_WIFI_STA_DISCONNECTED:
@@ -135,9 +139,30 @@ static const IPAddress MQTT_IP(MQTT_HOST);
 
 static AsyncMqttClient mqtt_client;
 
+// Pieces of a long message are reassembled here
+static uint8_t message_buf[MAX_MESSAGE_LEN];
+
 static on_connect_cb user_connect_cb{};
 static on_message_cb user_message_cb{};
 
+// Traffic, written from the MQTT task
+struct traffic_t {
+    uint32_t callbacks;   // on_message calls, one per packet
+    uint32_t dispatched;  // whole messages handed to the user callback
+    uint32_t round_trips; // acks sent for QoS 1+ messages, and acks received for ours
+};
+
+static volatile traffic_t traffic{};
+
+// Connection churn, also written from the MQTT task
+static volatile uint32_t connects = 0;
+static volatile uint32_t disconnects = 0;
+static traffic_t traffic_at_minute{};
+static traffic_t traffic_per_min{};
+static unsigned long minute_started_ms = 0;
+
+constexpr static unsigned long STATS_INTERVAL_MS = 60 * 1000;
+
 static_assert(
     sizeof(AsyncMqttClientMessageProperties) <= sizeof(void*),
     "MQTT msg properties can fit in a register"
@@ -149,6 +174,7 @@ static void
 on_connect(bool session_present)
 {
     log_i("MQTT Connected, session: %s", session_present ? "YES" : "NO");
+    ++connects;
     print_status();
 
     if (user_connect_cb)
@@ -159,6 +185,7 @@ static void
 on_disconnect(AsyncMqttClientDisconnectReason reason)
 {
     log_w("MQTT Disconnected, reason: %d");
+    ++disconnects;
 
     if (WiFi.isConnected())
         xTimerStart(mqtt_reconnect_timer, 0);
@@ -180,6 +207,24 @@ static void
 on_publish(uint16_t packet_id)
 {
     log_i("MQTT publish with ID %d", packet_id);
+    ++traffic.round_trips;
+}
+
+static void
+dispatch(char* topic, uint8_t* payload, size_t len, AsyncMqttClientMessageProperties props)
+{
+    ++traffic.dispatched;
+    if (props.qos > 0)
+        ++traffic.round_trips;
+
+    // Call user callback
+    if (user_message_cb) {
+        String topic_str(topic);
+        user_message_cb(&topic_str, payload, len, props);
+    }
+
+    // Whatever it queued is picked up by the loop
+    idle::wake();
 }
 
 static void
@@ -198,19 +243,24 @@ on_message(
     log_d("Length: %zu, Index: %zu, Total: %zu", len, idx, total);
     log_d("Qos: %d, Dup: %d, Retain: %d", props.qos, props.dup, props.retain);
 
-    // TODO: support calling this function multiple times
-    if (idx != 0) {
-        log_e("Long messages not supported");
-        ESP.restart();
-    }
+    ++traffic.callbacks;
 
-    assert(len == total);
+    // Most messages arrive in one piece
+    if (len == total) {
+        dispatch(topic, reinterpret_cast<uint8_t*>(payload), len, props);
+        return;
+    }
 
-    // Call user callback
-    if (user_message_cb) {
-        String topic_str(topic);
-        user_message_cb(&topic_str, reinterpret_cast<uint8_t*>(payload), len, props);
+    // Put longer ones back together
+    if (total > MAX_MESSAGE_LEN) {
+        log_e("Message of %zu bytes is too long, dropping it", total);
+        return;
     }
+
+    memcpy(message_buf + idx, payload, len);
+
+    if (idx + len == total)
+        dispatch(topic, message_buf, total, props);
 }
 
 static void
@@ -261,6 +311,60 @@ print_status() noexcept
         mqtt_client.connected() ? "YES" : "NO",
         mqtt_client.getClientId()
     );
+
+    log_i(
+        "Last minute: %lu callbacks, %lu messages, %lu broker round trips",
+        traffic_per_min.callbacks,
+        traffic_per_min.dispatched,
+        traffic_per_min.round_trips
+    );
+}
+
+stats_t
+stats() noexcept
+{
+    return {
+        mqtt_client.connected(),
+        connects,
+        disconnects,
+        traffic.dispatched,
+        traffic.round_trips,
+    };
+}
+
+void
+poll() noexcept
+{
+    if (millis() - minute_started_ms < STATS_INTERVAL_MS)
+        return;
+
+    minute_started_ms = millis();
+
+    traffic_t now{traffic.callbacks, traffic.dispatched, traffic.round_trips};
+    traffic_per_min = {
+        now.callbacks - traffic_at_minute.callbacks,
+        now.dispatched - traffic_at_minute.dispatched,
+        now.round_trips - traffic_at_minute.round_trips,
+    };
+    traffic_at_minute = now;
+
+    if (!mqtt_client.connected())
+        return;
+
+    char stats_str[96];
+    int len = snprintf(
+        stats_str,
+        sizeof(stats_str),
+        "{\"callbacks\":%lu,\"messages\":%lu,\"round_trips\":%lu}",
+        static_cast<unsigned long>(traffic_per_min.callbacks),
+        static_cast<unsigned long>(traffic_per_min.dispatched),
+        static_cast<unsigned long>(traffic_per_min.round_trips)
+    );
+
+    // Counted in the next minute, like any other publish
+    auto id = publish("display/stats/mqtt", 0, false, stats_str, len);
+    if (!id)
+        log_w("Error publishing MQTT stats");
 }
 
 uint16_t
@@ -300,6 +404,7 @@ wifi_timer_cb(TimerHandle_t handle) noexcept
 {
     (void)handle;
     *should_reconnect_wifi = true;
+    idle::wake();
 }
 
 static void
@@ -307,6 +412,7 @@ mqtt_timer_cb(TimerHandle_t handle) noexcept
 {
     (void)handle;
     *should_reconnect_mqtt = true;
+    idle::wake();
 }
 
 void
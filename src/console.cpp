@@ -0,0 +1,115 @@
+#include "console.hpp"
+
+namespace {
+
+struct command_t {
+    const char* name;
+    const char* usage;
+    console::command_fn fn;
+};
+
+command_t commands[console::MAX_COMMANDS];
+uint8_t num_commands = 0;
+
+char line[console::LINE_LEN];
+size_t line_len = 0;
+bool line_overflowed = false;
+
+void
+print_help(int argc, char** argv)
+{
+    (void)argc;
+    (void)argv;
+
+    for (uint8_t i = 0; i < num_commands; ++i)
+        log_i("%-8s %s", commands[i].name, commands[i].usage);
+}
+
+void
+run_line()
+{
+    // Split into arguments in place
+    char* argv[console::MAX_ARGS];
+    int argc = 0;
+
+    char* save;
+    for (char* arg = strtok_r(line, " \t", &save); arg; arg = strtok_r(nullptr, " \t", &save)) {
+        if (argc == console::MAX_ARGS) {
+            log_e("Too many arguments");
+            return;
+        }
+
+        argv[argc++] = arg;
+    }
+
+    if (argc == 0)
+        return;
+
+    for (uint8_t i = 0; i < num_commands; ++i) {
+        if (strcmp(argv[0], commands[i].name) == 0) {
+            commands[i].fn(argc, argv);
+            return;
+        }
+    }
+
+    log_w("Unknown command \"%s\", try \"help\"", argv[0]);
+}
+
+} // namespace
+
+namespace console {
+
+bool
+add(const char* name, const char* usage, command_fn fn) noexcept
+{
+    if (num_commands == 0)
+        commands[num_commands++] = {"help", "list commands", print_help};
+
+    if (num_commands == MAX_COMMANDS) {
+        log_e("No room for command %s", name);
+        assert(!"Out of console commands, raise MAX_COMMANDS");
+        return false;
+    }
+
+    commands[num_commands++] = {name, usage, fn};
+    return true;
+}
+
+void
+poll() noexcept
+{
+    while (Serial.available()) {
+        char c = Serial.read();
+
+        switch (c) {
+            case '\r':
+            case '\n':
+                if (line_overflowed) {
+                    log_e("Command longer than %zu characters", LINE_LEN - 1);
+                }
+                else {
+                    line[line_len] = '\0';
+                    run_line();
+                }
+
+                line_len = 0;
+                line_overflowed = false;
+                break;
+
+            case '\b':
+            case 0x7f: // DEL
+                if (line_len)
+                    --line_len;
+                break;
+
+            default:
+                if (line_len < LINE_LEN - 1)
+                    line[line_len++] = c;
+                else
+                    line_overflowed = true;
+                break;
+        }
+    }
+}
+
+} // namespace console
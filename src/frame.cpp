@@ -0,0 +1,386 @@
+#include "frame.hpp"
+
+#include "config.h"
+#include "geometry.hpp"
+#include "idle.hpp"
+
+#include <esp_timer.h>
+
+#include <atomic>
+#include <cstring>
+
+namespace frame {
+
+static uint8_t back = 0;
+static uint8_t dirty = (1 << BUFFER_COUNT) - 1; // contents are unknown at boot
+
+// Brightness each buffer wants to be shown at, NO_BRIGHTNESS until drawn
+constexpr int16_t NO_BRIGHTNESS = -1;
+
+static int16_t buffer_brightness[BUFFER_COUNT] = {NO_BRIGHTNESS, NO_BRIGHTNESS};
+static int16_t panel_brightness = NO_BRIGHTNESS;
+
+// Scheduled flips
+static esp_timer_handle_t flip_timer = nullptr;
+static MatrixPanel_I2S_DMA* flip_display = nullptr;
+static int64_t flip_at_us = 0;
+static std::atomic<bool> pending{false};
+
+static flip_stats_t stats{};
+
+// DMA memory, and what single buffering spends instead
+static size_t display_dma_bytes = 0;
+static size_t shadow_bytes = 0;
+
+#ifndef MAT_DOUBLE_BUFF
+constexpr int16_t W = panel_geometry::width;
+constexpr int16_t H = panel_geometry::height;
+
+static GFXcanvas16* shadow = nullptr; // being drawn
+static GFXcanvas16* shown = nullptr;  // what the panel shows
+static bool push_all = true;          // the panel shows something else
+#endif
+
+static push_stats_t pushes{};
+
+// Drawing load, over a window of a second
+constexpr int64_t LOAD_WINDOW_US = 1000 * 1000;
+
+static load_t current_load{};
+static load_t last_load{};
+static int64_t load_started_us = 0;
+
+void
+begin(size_t dma_bytes) noexcept
+{
+    display_dma_bytes = dma_bytes;
+
+#ifndef MAT_DOUBLE_BUFF
+    shadow = new GFXcanvas16(W, H);
+    shown = new GFXcanvas16(W, H);
+
+    if (!shadow->getBuffer() || !shown->getBuffer()) {
+        log_e("Error allocating shadow frames");
+        abort();
+    }
+
+    shadow->cp437(true); // like the display, see setup_led_matrix()
+    shadow_bytes = 2 * panel_geometry::frame_bytes;
+#endif
+}
+
+Adafruit_GFX*
+target(MatrixPanel_I2S_DMA* display) noexcept
+{
+#ifdef MAT_DOUBLE_BUFF
+    return display;
+#else
+    (void)display;
+    return shadow;
+#endif
+}
+
+void
+forget_panel() noexcept
+{
+#ifndef MAT_DOUBLE_BUFF
+    push_all = true;
+#endif
+}
+
+uint8_t
+back_buffer() noexcept
+{
+    return back;
+}
+
+bool
+needs_full_redraw() noexcept
+{
+    return dirty & (1 << back);
+}
+
+void
+invalidate() noexcept
+{
+    dirty = (1 << BUFFER_COUNT) - 1;
+}
+
+#ifndef MAT_DOUBLE_BUFF
+/**
+ * Copy the pixels of row `y` that changed onto the panel.
+ */
+static void
+push_row(MatrixPanel_I2S_DMA* display, int16_t y)
+{
+    const uint16_t* drawn = shadow->getBuffer() + y * W;
+    uint16_t* on_panel = shown->getBuffer() + y * W;
+
+    int16_t x = 0;
+    while (x < W) {
+        if (!push_all && drawn[x] == on_panel[x]) {
+            ++x;
+            continue;
+        }
+
+        int16_t start = x;
+        while (x < W && (push_all || drawn[x] != on_panel[x]))
+            ++x;
+
+        // Runs of one color go in as lines, the library's fastest path
+        for (int16_t a = start; a < x;) {
+            int16_t b = a + 1;
+            while (b < x && drawn[b] == drawn[a])
+                ++b;
+
+            display->drawFastHLine(a, y, b - a, drawn[a]);
+            a = b;
+        }
+
+        memcpy(on_panel + start, drawn + start, (x - start) * sizeof(uint16_t));
+
+        ++pushes.spans;
+        pushes.pixels += x - start;
+    }
+}
+
+static void
+push(MatrixPanel_I2S_DMA* display)
+{
+    int64_t started_us = esp_timer_get_time();
+
+    // Rows y and y + H / 2 are scanned out together
+    for (int16_t y = 0; y < H / 2; ++y) {
+        push_row(display, y);
+        push_row(display, y + H / 2);
+    }
+
+    push_all = false;
+
+    int64_t push_us = esp_timer_get_time() - started_us;
+
+    ++pushes.pushes;
+    pushes.push_us += push_us;
+    pushes.max_push_us = max(pushes.max_push_us, push_us);
+}
+#endif
+
+void
+flip(MatrixPanel_I2S_DMA* display) noexcept
+{
+    dirty &= ~(1 << back);
+
+#ifdef MAT_DOUBLE_BUFF
+    display->flipDMABuffer();
+    back ^= 1;
+#else
+    push(display);
+#endif
+}
+
+/*****************************************************************************/
+
+static uint8_t
+front_buffer()
+{
+#ifdef MAT_DOUBLE_BUFF
+    return back ^ 1;
+#else
+    return back;
+#endif
+}
+
+void
+set_brightness(uint8_t brightness) noexcept
+{
+    buffer_brightness[back] = brightness;
+}
+
+void
+apply_brightness(MatrixPanel_I2S_DMA* display) noexcept
+{
+    int16_t brightness = buffer_brightness[front_buffer()];
+
+    if (brightness == NO_BRIGHTNESS || brightness == panel_brightness)
+        return;
+
+    display->setBrightness8(brightness);
+    panel_brightness = brightness;
+}
+
+/*****************************************************************************/
+
+static void
+do_scheduled_flip(void*)
+{
+    int64_t skew_us = esp_timer_get_time() - flip_at_us;
+
+    flip(flip_display);
+
+    ++stats.flips;
+    stats.skew_us += skew_us;
+    stats.max_skew_us = max(stats.max_skew_us, skew_us);
+
+    pending = false;
+
+    // The loop can draw the next one now
+    idle::wake();
+}
+
+void
+schedule_flip(MatrixPanel_I2S_DMA* display, int64_t at_us) noexcept
+{
+    if (!flip_timer) {
+        esp_timer_create_args_t args = {};
+        args.callback = do_scheduled_flip;
+        args.dispatch_method = ESP_TIMER_TASK;
+        args.name = "frame_flip";
+
+        if (esp_timer_create(&args, &flip_timer) != ESP_OK) {
+            log_e("Error creating flip timer");
+            abort();
+        }
+    }
+
+    flip_display = display;
+    flip_at_us = at_us;
+    pending = true;
+
+    int64_t wait_us = at_us - esp_timer_get_time();
+    if (wait_us <= 0) {
+        ++stats.late;
+        do_scheduled_flip(nullptr);
+        return;
+    }
+
+    esp_timer_start_once(flip_timer, wait_us);
+}
+
+bool
+flip_pending() noexcept
+{
+    return pending;
+}
+
+flip_stats_t
+flip_stats() noexcept
+{
+    return stats;
+}
+
+push_stats_t
+push_stats() noexcept
+{
+    return pushes;
+}
+
+size_t
+dma_bytes() noexcept
+{
+    return display_dma_bytes;
+}
+
+void
+record_dropped(uint32_t count) noexcept
+{
+    stats.dropped += count;
+}
+
+/*****************************************************************************/
+
+static void
+roll_load_window()
+{
+    int64_t now_us = esp_timer_get_time();
+    int64_t elapsed_us = now_us - load_started_us;
+
+    if (elapsed_us < LOAD_WINDOW_US)
+        return;
+
+    // A long quiet stretch is one idle window, not many
+    current_load.window_us = elapsed_us < 2 * LOAD_WINDOW_US ? elapsed_us : LOAD_WINDOW_US;
+    last_load = current_load;
+
+    current_load = {};
+    load_started_us = now_us;
+}
+
+void
+record_render(uint32_t render_us) noexcept
+{
+    roll_load_window();
+
+    ++current_load.frames;
+    current_load.render_us += render_us;
+
+    ++stats.rendered;
+    stats.render_us += render_us;
+}
+
+load_t
+load() noexcept
+{
+    roll_load_window();
+    return last_load;
+}
+
+void
+reset_stats() noexcept
+{
+    stats = {};
+    pushes = {};
+}
+
+void
+print_status() noexcept
+{
+    flip_stats_t s = stats;
+
+    log_i(
+        "Frames: %lu scheduled flips, %lu late, %lu dropped, skew avg %lld us, max %lld us",
+        s.flips,
+        s.late,
+        s.dropped,
+        s.flips ? s.skew_us / s.flips : 0,
+        s.max_skew_us
+    );
+
+    load_t l = load();
+    uint32_t busy_pct = l.window_us ? static_cast<uint64_t>(l.render_us) * 100 / l.window_us : 0;
+
+    log_i(
+        "Last second: %lu frames, drawing %lu%% of the time, idle %lu%%",
+        l.frames,
+        busy_pct,
+        100 - busy_pct
+    );
+
+#ifdef MAT_DOUBLE_BUFF
+    log_i(
+        "DMA buffers: %u bytes double buffered, single buffering would free about %u",
+        display_dma_bytes,
+        display_dma_bytes / 2
+    );
+#else
+    // A second DMA buffer would be as big as the one we have
+    log_i(
+        "DMA buffers: %u bytes single buffered, saving %u, less %u for shadow frames",
+        display_dma_bytes,
+        display_dma_bytes,
+        shadow_bytes
+    );
+
+    push_stats_t p = pushes;
+
+    log_i(
+        "Partial updates: %lu, avg %lu spans, %lu pixels, %lld us, max %lld us",
+        p.pushes,
+        p.pushes ? p.spans / p.pushes : 0,
+        p.pushes ? p.pixels / p.pushes : 0,
+        p.pushes ? p.push_us / p.pushes : 0,
+        p.max_push_us
+    );
+#endif
+}
+
+} // namespace frame
@@ -0,0 +1,516 @@
+#include "heap_stats.hpp"
+
+#include "connections.hpp"
+
+#include <esp_heap_caps.h>
+
+#include <cstring>
+
+namespace {
+
+using heap_stats::tag_stats_t;
+using heap_stats::tag_t;
+
+// WiFi, lwIP and MQTT alone keep several hundred blocks live, and the table can
+// only be filled to 3/4 before probing falls apart. 16 KiB of DRAM; if it still
+// fills up, live bytes are reported as partial
+constexpr size_t TABLE_SIZE = 2048; // power of two
+constexpr size_t TABLE_MAX_LOAD = TABLE_SIZE * 3 / 4;
+constexpr uint32_t MAX_BLOCK_SIZE = (1 << 24) - 1;
+
+constexpr uint8_t MAX_TASKS = 16;
+
+constexpr unsigned long SAMPLE_INTERVAL_MS = 60 * 1000; // 1 minute
+constexpr uint8_t SAMPLES_PER_SLOT = 60;                // 1 hour
+constexpr size_t HISTORY_SLOTS = 7 * 24;                // 1 week
+
+struct block_t {
+    uintptr_t ptr; // 0 if empty
+    uint32_t size : 24;
+    uint32_t tag : 8;
+};
+
+struct task_t {
+    TaskHandle_t handle;
+    tag_t task_tag;
+    tag_t scope_tag; // TAG_LAST outside of a scope
+};
+
+struct heap_sample_t {
+    uint32_t min_free;
+    uint32_t min_largest_block;
+};
+
+portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+
+tag_stats_t tag_stats[heap_stats::TAG_LAST];
+uint32_t untracked_allocs = 0;
+
+// Once a block goes untracked, it's missing from live bytes for as long as it
+// lives, and there's no telling when that is
+bool live_partial = false;
+
+#ifdef HEAP_STATS
+// Live blocks, open addressing with linear probing
+block_t blocks[TABLE_SIZE];
+size_t num_blocks = 0;
+size_t peak_blocks = 0;
+
+task_t tasks[MAX_TASKS];
+uint8_t num_tasks = 0;
+#endif
+
+uint32_t allocs_at_last_sample[heap_stats::TAG_LAST];
+
+// Free heap over time, the lowest seen in each slot
+heap_sample_t history[HISTORY_SLOTS];
+size_t history_head = 0;
+size_t history_len = 0;
+uint8_t samples_in_slot = 0;
+unsigned long last_sample_ms = 0;
+
+/*      TABLE (call with mux held)      */
+
+#ifdef HEAP_STATS
+
+inline size_t
+home_slot(uintptr_t ptr)
+{
+    return (ptr >> 3) & (TABLE_SIZE - 1); // blocks are 8 byte aligned
+}
+
+tag_t
+task_tag_for(const char* name)
+{
+    if (strcmp(name, "async_tcp") == 0)
+        return heap_stats::TAG_MQTT;
+
+    if (strcmp(name, "wifi") == 0 || strcmp(name, "tiT") == 0
+        || strcmp(name, "sys_evt") == 0 || strcmp(name, "arduino_events") == 0)
+        return heap_stats::TAG_WIFI;
+
+    if (strcmp(name, "time_sync") == 0)
+        return heap_stats::TAG_EZTIME;
+
+    return heap_stats::TAG_OTHER;
+}
+
+task_t*
+find_task(TaskHandle_t handle)
+{
+    for (uint8_t i = 0; i < num_tasks; ++i) {
+        if (tasks[i].handle == handle)
+            return &tasks[i];
+    }
+
+    if (num_tasks == MAX_TASKS)
+        return nullptr;
+
+    tasks[num_tasks] = {handle, task_tag_for(pcTaskGetTaskName(handle)), heap_stats::TAG_LAST};
+    return &tasks[num_tasks++];
+}
+
+tag_t
+current_tag()
+{
+    TaskHandle_t handle = xTaskGetCurrentTaskHandle();
+    if (!handle) // scheduler isn't running yet
+        return heap_stats::TAG_OTHER;
+
+    task_t* task = find_task(handle);
+    if (!task)
+        return heap_stats::TAG_OTHER;
+
+    return task->scope_tag != heap_stats::TAG_LAST ? task->scope_tag : task->task_tag;
+}
+
+void
+insert(void* ptr, size_t size, tag_t tag)
+{
+    tag_stats_t& stats = tag_stats[tag];
+
+    if (num_blocks >= TABLE_MAX_LOAD || size > MAX_BLOCK_SIZE) {
+        ++untracked_allocs;
+        live_partial = true;
+        return;
+    }
+
+    size_t slot = home_slot(reinterpret_cast<uintptr_t>(ptr));
+    while (blocks[slot].ptr)
+        slot = (slot + 1) & (TABLE_SIZE - 1);
+
+    blocks[slot] = {reinterpret_cast<uintptr_t>(ptr), static_cast<uint32_t>(size), tag};
+    if (++num_blocks > peak_blocks)
+        peak_blocks = num_blocks;
+
+    stats.live_bytes += size;
+    if (stats.live_bytes > stats.peak_bytes)
+        stats.peak_bytes = stats.live_bytes;
+}
+
+/**
+ * Forget about a block.
+ *
+ * @returns false if it wasn't being tracked.
+ */
+bool
+remove(void* ptr, block_t* removed)
+{
+    uintptr_t addr = reinterpret_cast<uintptr_t>(ptr);
+
+    size_t slot = home_slot(addr);
+    while (blocks[slot].ptr != addr) {
+        if (!blocks[slot].ptr)
+            return false;
+
+        slot = (slot + 1) & (TABLE_SIZE - 1);
+    }
+
+    *removed = blocks[slot];
+    tag_stats[removed->tag].live_bytes -= removed->size;
+    --num_blocks;
+
+    // Shift back entries that probed past the hole
+    size_t hole = slot;
+    for (size_t next = (hole + 1) & (TABLE_SIZE - 1); blocks[next].ptr;
+         next = (next + 1) & (TABLE_SIZE - 1)) {
+        size_t home = home_slot(blocks[next].ptr);
+        size_t dist_home = (next - home) & (TABLE_SIZE - 1);
+        size_t dist_hole = (next - hole) & (TABLE_SIZE - 1);
+
+        if (dist_home >= dist_hole) {
+            blocks[hole] = blocks[next];
+            hole = next;
+        }
+    }
+
+    blocks[hole].ptr = 0;
+    return true;
+}
+
+void
+track(void* ptr, size_t size)
+{
+    portENTER_CRITICAL(&mux);
+
+    tag_t tag = current_tag();
+    ++tag_stats[tag].allocs;
+    tag_stats[tag].alloc_bytes += size;
+
+    insert(ptr, size, tag);
+
+    portEXIT_CRITICAL(&mux);
+}
+
+bool
+untrack(void* ptr, block_t* removed)
+{
+    portENTER_CRITICAL(&mux);
+    bool found = remove(ptr, removed);
+    portEXIT_CRITICAL(&mux);
+
+    return found;
+}
+#endif // HEAP_STATS
+
+/*      SAMPLING      */
+
+heap_sample_t
+sample()
+{
+    heap_sample_t now{
+        static_cast<uint32_t>(heap_caps_get_free_size(MALLOC_CAP_8BIT)),
+        static_cast<uint32_t>(heap_caps_get_largest_free_block(MALLOC_CAP_8BIT)),
+    };
+
+    // Start a new slot every so often
+    if (samples_in_slot == SAMPLES_PER_SLOT || history_len == 0) {
+        if (history_len != 0)
+            history_head = (history_head + 1) % HISTORY_SLOTS;
+
+        history_len = min(history_len + 1, HISTORY_SLOTS);
+        history[history_head] = now;
+        samples_in_slot = 0;
+    }
+
+    heap_sample_t& slot = history[history_head];
+    slot.min_free = min(slot.min_free, now.min_free);
+    slot.min_largest_block = min(slot.min_largest_block, now.min_largest_block);
+    ++samples_in_slot;
+
+    // Allocation rates
+    portENTER_CRITICAL(&mux);
+
+    for (uint8_t tag = 0; tag < heap_stats::TAG_LAST; ++tag) {
+        tag_stats[tag].allocs_per_min = tag_stats[tag].allocs - allocs_at_last_sample[tag];
+        allocs_at_last_sample[tag] = tag_stats[tag].allocs;
+    }
+
+    portEXIT_CRITICAL(&mux);
+    return now;
+}
+
+void
+publish(const heap_sample_t& now)
+{
+    char stats_str[640];
+    int len = snprintf(
+        stats_str,
+        sizeof(stats_str),
+        "{\"free\":%lu,\"largest_block\":%lu,\"untracked\":%lu,\"partial\":%s",
+        static_cast<unsigned long>(now.min_free),
+        static_cast<unsigned long>(now.min_largest_block),
+        static_cast<unsigned long>(untracked_allocs),
+        live_partial ? "true" : "false"
+    );
+
+#ifdef HEAP_STATS
+    for (uint8_t i = 0; i < heap_stats::TAG_LAST; ++i) {
+        tag_t tag = static_cast<tag_t>(i);
+        tag_stats_t stats = heap_stats::get(tag);
+
+        len += snprintf(
+            stats_str + len,
+            sizeof(stats_str) - len,
+            ",\"%s\":{\"live\":%lu,\"peak\":%lu,\"allocs_per_min\":%lu}",
+            heap_stats::tag_name(tag),
+            static_cast<unsigned long>(stats.live_bytes),
+            static_cast<unsigned long>(stats.peak_bytes),
+            static_cast<unsigned long>(stats.allocs_per_min)
+        );
+    }
+#endif
+
+    len += snprintf(stats_str + len, sizeof(stats_str) - len, "}");
+
+    auto id = mqtt::publish("display/stats/heap", 0, false, stats_str, len);
+    if (!id)
+        log_w("Error publishing heap stats to MQTT");
+}
+
+} // namespace
+
+/*****************************************************************************/
+
+// Link-time wrappers, only in builds with HEAP_STATS, see platformio.ini.
+//
+// They aren't in IRAM: nothing may allocate while the flash cache is off, so
+// they never run then.
+#ifdef HEAP_STATS
+extern "C" {
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+void __real_free(void* ptr);
+
+void*
+__wrap_malloc(size_t size)
+{
+    void* ptr = __real_malloc(size);
+    if (ptr)
+        track(ptr, size);
+
+    return ptr;
+}
+
+void*
+__wrap_calloc(size_t count, size_t size)
+{
+    void* ptr = __real_calloc(count, size);
+    if (ptr)
+        track(ptr, count * size);
+
+    return ptr;
+}
+
+void*
+__wrap_realloc(void* ptr, size_t size)
+{
+    // Forget the old block first, its address may be handed out again as soon as
+    // realloc returns
+    block_t old;
+    bool tracked = ptr && untrack(ptr, &old);
+
+    void* new_ptr = __real_realloc(ptr, size);
+
+    if (new_ptr) {
+        track(new_ptr, size);
+    }
+    else if (tracked && size != 0) { // old block is still there
+        portENTER_CRITICAL(&mux);
+        insert(ptr, old.size, static_cast<tag_t>(old.tag));
+        portEXIT_CRITICAL(&mux);
+    }
+
+    return new_ptr;
+}
+
+void
+__wrap_free(void* ptr)
+{
+    block_t old;
+    if (ptr)
+        untrack(ptr, &old);
+
+    __real_free(ptr);
+}
+
+} // extern "C"
+#endif // HEAP_STATS
+
+/*****************************************************************************/
+
+namespace heap_stats {
+
+scope::scope(tag_t tag) noexcept
+{
+#ifdef HEAP_STATS
+    portENTER_CRITICAL(&mux);
+
+    task_t* task = find_task(xTaskGetCurrentTaskHandle());
+    prev_ = task ? task->scope_tag : TAG_LAST;
+
+    if (task)
+        task->scope_tag = tag;
+
+    portEXIT_CRITICAL(&mux);
+#else
+    prev_ = tag;
+#endif
+}
+
+scope::~scope() noexcept
+{
+#ifdef HEAP_STATS
+    portENTER_CRITICAL(&mux);
+
+    task_t* task = find_task(xTaskGetCurrentTaskHandle());
+    if (task)
+        task->scope_tag = prev_;
+
+    portEXIT_CRITICAL(&mux);
+#endif
+}
+
+const char*
+tag_name(tag_t tag) noexcept
+{
+    switch (tag) {
+        case TAG_RENDER:
+            return "render";
+        case TAG_MQTT:
+            return "mqtt";
+        case TAG_WIFI:
+            return "wifi";
+        case TAG_EZTIME:
+            return "eztime";
+        case TAG_STRING:
+            return "string";
+        case TAG_OTHER:
+        default:
+            return "other";
+    }
+}
+
+tag_stats_t
+get(tag_t tag) noexcept
+{
+    portENTER_CRITICAL(&mux);
+    tag_stats_t stats = tag_stats[tag];
+    portEXIT_CRITICAL(&mux);
+
+    return stats;
+}
+
+bool
+partial() noexcept
+{
+    return live_partial;
+}
+
+void
+poll() noexcept
+{
+    if (history_len != 0 && millis() - last_sample_ms < SAMPLE_INTERVAL_MS)
+        return;
+
+    last_sample_ms = millis();
+    publish(sample());
+}
+
+void
+print_status() noexcept
+{
+    size_t free = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    size_t largest = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+
+    log_i(
+        "Heap: %zu B free, largest block %zu B (%.1f%% fragmented), %zu B minimum ever",
+        free,
+        largest,
+        free ? 100.0f * (1.0f - float(largest) / free) : 0.0f,
+        heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT)
+    );
+#ifdef HEAP_STATS
+    log_i(
+        "Tracking %zu/%zu blocks (peak %zu), %lu allocations untracked",
+        num_blocks,
+        TABLE_MAX_LOAD,
+        peak_blocks,
+        untracked_allocs
+    );
+    if (live_partial)
+        log_w("Some blocks went untracked, live bytes are low by an unknown amount");
+
+    for (uint8_t i = 0; i < TAG_LAST; ++i) {
+        tag_t tag = static_cast<tag_t>(i);
+        tag_stats_t stats = get(tag);
+
+        log_i(
+            "%-8s live %6lu B, peak %6lu B, %lu allocs (%lu B), %lu allocs/min",
+            tag_name(tag),
+            stats.live_bytes,
+            stats.peak_bytes,
+            stats.allocs,
+            stats.alloc_bytes,
+            stats.allocs_per_min
+        );
+    }
+#else
+    log_i("Per-subsystem accounting is off, build with HEAP_STATS to turn it on");
+#endif
+
+    // Most recent day of history, oldest first
+    size_t count = min<size_t>(history_len, 24);
+    for (size_t i = count; i-- > 0;) {
+        const heap_sample_t& slot = history[(history_head + HISTORY_SLOTS - i) % HISTORY_SLOTS];
+        log_i(
+            "%2zu h ago: min free %lu B, min largest block %lu B",
+            i,
+            slot.min_free,
+            slot.min_largest_block
+        );
+    }
+}
+
+void
+reset_stats() noexcept
+{
+    portENTER_CRITICAL(&mux);
+
+    for (tag_stats_t& stats : tag_stats)
+        stats.peak_bytes = stats.live_bytes;
+
+    untracked_allocs = 0;
+#ifdef HEAP_STATS
+    peak_blocks = num_blocks;
+#endif
+
+    portEXIT_CRITICAL(&mux);
+
+    history_len = 0;
+    history_head = 0;
+}
+
+} // namespace heap_stats
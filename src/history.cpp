@@ -0,0 +1,282 @@
+#include "history.hpp"
+
+#include "connections.hpp"
+
+#include <esp_timer.h>
+#include <LittleFS.h>
+
+namespace {
+
+using history::kind_t;
+using history::record_t;
+using history::totals_t;
+
+constexpr uint32_t SECONDS_PER_DAY = 24 * 60 * 60;
+constexpr uint8_t DAYS_PER_WEEK = 7;
+
+void
+file_path(uint8_t index, char* buf, size_t len)
+{
+    snprintf(buf, len, "/history/%u.bin", index);
+}
+
+/**
+ * The ring's files, in /history on LittleFS.
+ */
+class littlefs_store : public history::file_store_t {
+public:
+    size_t
+    read(uint8_t index, size_t offset, void* buf, size_t len) override
+    {
+        char path[24];
+        file_path(index, path, sizeof(path));
+
+        File file = LittleFS.open(path, "r");
+        if (!file)
+            return 0;
+
+        size_t count = file.seek(offset) ? file.read(static_cast<uint8_t*>(buf), len) : 0;
+
+        file.close();
+        return count;
+    }
+
+    size_t
+    write(uint8_t index, bool truncate, const void* data, size_t len) override
+    {
+        char path[24];
+        file_path(index, path, sizeof(path));
+
+        File file = LittleFS.open(path, truncate ? "w" : "a");
+        if (!file) {
+            log_e("Error opening %s", path);
+            return 0;
+        }
+
+        size_t written = file.write(static_cast<const uint8_t*>(data), len);
+        if (written != len)
+            log_e("Error writing history to %s", path);
+
+        file.close();
+        return written;
+    }
+};
+
+bool mounted = false;
+
+littlefs_store files;
+history::log_t log_state{};
+
+// Totals per local day, indexed by day % DAYS_PER_WEEK
+struct day_totals_t {
+    uint32_t day;
+    totals_t totals;
+};
+
+day_totals_t days[DAYS_PER_WEEK]{};
+portMUX_TYPE days_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// Flash write latency, the rest of the stats are in `log_state`
+struct {
+    int64_t flush_us_total;
+    int64_t flush_us_max;
+    int64_t append_us_max;
+} stats{};
+
+// Helpers
+void
+add_to_totals(const record_t& record)
+{
+    uint32_t day = record.start / SECONDS_PER_DAY;
+
+    portENTER_CRITICAL(&days_mux);
+
+    day_totals_t& slot = days[day % DAYS_PER_WEEK];
+    if (slot.day < day) // slot holds a day more than a week old
+        slot = {day, {}};
+
+    if (slot.day == day) {
+        if (record.kind == history::KIND_WORK) {
+            ++slot.totals.pomodoros;
+            slot.totals.focus_seconds += record.duration_s;
+        }
+        else {
+            ++slot.totals.breaks;
+        }
+    }
+
+    portEXIT_CRITICAL(&days_mux);
+}
+
+totals_t
+sum_days(uint32_t first_day, uint32_t last_day)
+{
+    totals_t sum{};
+
+    portENTER_CRITICAL(&days_mux);
+
+    for (const day_totals_t& slot : days) {
+        if (slot.day >= first_day && slot.day <= last_day) {
+            sum.pomodoros += slot.totals.pomodoros;
+            sum.breaks += slot.totals.breaks;
+            sum.focus_seconds += slot.totals.focus_seconds;
+        }
+    }
+
+    portEXIT_CRITICAL(&days_mux);
+    return sum;
+}
+
+void
+publish_stats(uint32_t now)
+{
+    totals_t day = history::today(now);
+    totals_t week = history::week(now);
+
+    char stats_str[160];
+    int len = snprintf(
+        stats_str,
+        sizeof(stats_str),
+        "{\"today\":{\"pomodoros\":%u,\"breaks\":%u,\"focus_min\":%lu},"
+        "\"week\":{\"pomodoros\":%u,\"breaks\":%u,\"focus_min\":%lu}}",
+        day.pomodoros,
+        day.breaks,
+        static_cast<unsigned long>(day.focus_seconds / 60),
+        week.pomodoros,
+        week.breaks,
+        static_cast<unsigned long>(week.focus_seconds / 60)
+    );
+
+    auto id = mqtt::publish("display/history/stats", 0, false, stats_str, len);
+    if (!id)
+        log_w("Error publishing history stats to MQTT");
+}
+
+} // namespace
+
+namespace history {
+
+void
+begin() noexcept
+{
+    if (!LittleFS.begin(true)) {
+        log_e("Error mounting LittleFS, history is disabled");
+        return;
+    }
+
+    mounted = true;
+    LittleFS.mkdir("/history");
+
+    log_state.files = &files;
+    history::recover(&log_state, add_to_totals);
+
+    log_i(
+        "History resumes at record %lu in file %u",
+        static_cast<unsigned long>(log_state.next_seq),
+        log_state.current_file
+    );
+}
+
+void
+append(kind_t kind, uint32_t start, uint16_t duration_s) noexcept
+{
+    int64_t started_us = esp_timer_get_time();
+
+    // Flushing is left to poll(), this runs while a frame is being drawn
+    const record_t* record = history::append(&log_state, kind, start, duration_s, millis());
+    if (!record) {
+        log_e("History batch full, dropping record");
+        return;
+    }
+
+    add_to_totals(*record);
+
+    stats.append_us_max = max(stats.append_us_max, esp_timer_get_time() - started_us);
+}
+
+void
+flush() noexcept
+{
+    if (!mounted)
+        return;
+
+    int64_t started_us = esp_timer_get_time();
+
+    if (!history::flush(&log_state, millis()))
+        return;
+
+    int64_t elapsed_us = esp_timer_get_time() - started_us;
+    stats.flush_us_total += elapsed_us;
+    stats.flush_us_max = max(stats.flush_us_max, elapsed_us);
+}
+
+void
+poll() noexcept
+{
+    if (history::flush_due(&log_state, millis()))
+        flush();
+}
+
+totals_t
+today(uint32_t now) noexcept
+{
+    uint32_t day = now / SECONDS_PER_DAY;
+    return sum_days(day, day);
+}
+
+totals_t
+week(uint32_t now) noexcept
+{
+    uint32_t day = now / SECONDS_PER_DAY;
+    return sum_days(day - (DAYS_PER_WEEK - 1), day);
+}
+
+void
+on_mqtt_message(const String& subtopic, uint32_t now) noexcept
+{
+    if (subtopic == "query")
+        publish_stats(now);
+    else if (subtopic != "stats") // our own
+        log_w("Invalid history topic %s", subtopic.c_str());
+}
+
+void
+print_status() noexcept
+{
+    const history::log_stats_t& flash = log_state.stats;
+
+    log_i(
+        "History: %lu appends, %lu dropped, %u batched, next record %lu in file %u (%u/%u)",
+        static_cast<unsigned long>(flash.appends),
+        static_cast<unsigned long>(flash.dropped),
+        log_state.batch_len,
+        static_cast<unsigned long>(log_state.next_seq),
+        log_state.current_file,
+        log_state.records_in_file,
+        history::RECORDS_PER_FILE
+    );
+
+    // Everything we write is record data, so amplification comes from how often
+    // we make LittleFS commit
+    log_i(
+        "Flash: %lu flushes, %lu bytes, %.1f records/flush, %lu rotations",
+        static_cast<unsigned long>(flash.flushes),
+        static_cast<unsigned long>(flash.bytes_written),
+        flash.flushes ? flash.bytes_written / sizeof(record_t) / float(flash.flushes) : 0.0f,
+        static_cast<unsigned long>(flash.rotations)
+    );
+    log_i(
+        "Latency: append max %lld us, flush avg %lld us, flush max %lld us",
+        stats.append_us_max,
+        flash.flushes ? stats.flush_us_total / flash.flushes : 0,
+        stats.flush_us_max
+    );
+
+    if (mounted) {
+        log_i(
+            "LittleFS: %zu/%zu bytes used", LittleFS.usedBytes(), LittleFS.totalBytes()
+        );
+    }
+}
+
+} // namespace history
@@ -0,0 +1,119 @@
+#include "idle.hpp"
+
+#include <Arduino.h>
+#include <esp_timer.h>
+
+namespace {
+
+constexpr int64_t LOAD_WINDOW_US = 1000 * 1000;
+
+TaskHandle_t loop_task = nullptr;
+
+idle::stats_t totals{};
+
+// Like frame's load, over whole seconds
+int64_t load_started_us = 0;
+idle::load_t current_load{};
+idle::load_t last_load{};
+
+void
+roll_load_window()
+{
+    int64_t now_us = esp_timer_get_time();
+    int64_t elapsed_us = now_us - load_started_us;
+
+    if (elapsed_us < LOAD_WINDOW_US)
+        return;
+
+    // A long wait is one window, not many
+    current_load.window_us = elapsed_us < 2 * LOAD_WINDOW_US ? elapsed_us : LOAD_WINDOW_US;
+    last_load = current_load;
+
+    current_load = {};
+    load_started_us = now_us;
+}
+
+} // namespace
+
+namespace idle {
+
+void
+begin() noexcept
+{
+    loop_task = xTaskGetCurrentTaskHandle();
+
+    Serial.onReceive([] { wake(); });
+}
+
+void
+wake() noexcept
+{
+    if (loop_task)
+        xTaskNotifyGive(loop_task);
+}
+
+void
+wait_until(int64_t deadline_us) noexcept
+{
+    int64_t started_us = esp_timer_get_time();
+
+    uint32_t wait = wait_ms(started_us, deadline_us);
+    if (!wait)
+        return;
+
+    // Also picks up a wake() from while we were busy, without blocking
+    bool woken = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait)) != 0;
+    uint32_t idle_us = esp_timer_get_time() - started_us;
+
+    ++totals.wakeups;
+    totals.woken += woken;
+    totals.idle_us += idle_us;
+
+    roll_load_window();
+
+    ++current_load.wakeups;
+    current_load.woken += woken;
+    current_load.idle_us += idle_us;
+}
+
+load_t
+load() noexcept
+{
+    roll_load_window();
+    return last_load;
+}
+
+stats_t
+stats() noexcept
+{
+    return totals;
+}
+
+void
+print_status() noexcept
+{
+    load_t l = load();
+    uint32_t idle_pct = l.window_us ? static_cast<uint64_t>(l.idle_us) * 100 / l.window_us : 0;
+
+    log_i(
+        "Last second: idle %lu%%, %lu wakeups, %lu of them early",
+        idle_pct,
+        l.wakeups,
+        l.woken
+    );
+
+    log_i(
+        "Since reset: %lu wakeups, %lu early, %lld ms idle",
+        totals.wakeups,
+        totals.woken,
+        totals.idle_us / 1000
+    );
+}
+
+void
+reset_stats() noexcept
+{
+    totals = {};
+}
+
+} // namespace idle
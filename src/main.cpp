@@ -2,13 +2,31 @@
 #include <Arduino.h>
 
 // Other includes
-#include "clock.hpp"
+#include "anim.hpp"
+#include "bench.hpp"
 #include "config.h"
 #include "connections.hpp"
+#include "console.hpp"
+#include "frame.hpp"
+#include "geometry.hpp"
+#include "heap_stats.hpp"
+#include "history.hpp"
+#include "idle.hpp"
+#include "metrics.hpp"
+#include "modes.hpp"
+#include "ota.hpp"
 #include "pomodoro.hpp"
+#include "settings.hpp"
+#include "shader.hpp"
+#include "stall.hpp"
+#include "ticker.hpp"
+#include "time_sync.hpp"
+#include "timebase.hpp"
 #include "utils.hpp"
 
 #include <WiFi.h>
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
 
 #include <ESP32-HUB75-MatrixPanel-I2S-DMA.h>
 
@@ -23,14 +41,11 @@
 
 #include <cstdint>
 
-enum display_mode_t : int8_t {
-    DISP_MODE_NONE = -1,
-    //
-    DISP_MODE_CLOCK = 0,
-    DISP_MODE_POMODORO,
-    //
-    DISP_MODE_LAST,
-};
+// Modes are indices into modes::MODES, this is a blank screen
+constexpr int8_t DISP_MODE_NONE = -1;
+
+// How long to wait for a host on USB serial at boot
+constexpr unsigned long SERIAL_WAIT_MS = 2000;
 
 namespace {
 
@@ -43,12 +58,25 @@ bool timezones_need_refresh = true; // refresh on boot
 Timezone local_tz;
 
 // Display settings
-display_mode_t display_mode = DISP_MODE_NONE;
+int8_t display_mode = DISP_MODE_NONE;
 uint8_t display_brightness = 127;
 
 uint8_t display_color[3] = {0xff, 0xff, 0xff}; // r, g, b
 uint16_t display_color_565 = 0xffff;
 
+// Bumped on every settings change, static screens are redrawn when it moves
+volatile uint32_t settings_version = 0;
+
+void
+set_display_color(uint8_t r, uint8_t g, uint8_t b)
+{
+    display_color[0] = r;
+    display_color[1] = g;
+    display_color[2] = b;
+
+    display_color_565 = MatrixPanel_I2S_DMA::color565(r, g, b);
+}
+
 } // namespace
 
 /*****************************************************************************/
@@ -56,15 +84,51 @@ uint16_t display_color_565 = 0xffff;
 namespace {
 
 constexpr size_t MQTT_TOPIC_LEN = sizeof("display/") - 1;
+constexpr size_t MQTT_OTA_TOPIC_LEN = sizeof("display/ota/") - 1;
+
+struct subscription_t {
+    const char* topic;
+    uint8_t qos;
+};
+
+/*
+ * Everything we act on, and nothing we publish ourselves, so our own
+ * count/status/stats messages never come back to us.
+ *
+ * Settings are QoS 1 so they survive a flaky link. Chunks and queries are
+ * QoS 0 because the sender already retries them after a missing reply.
+ */
+constexpr subscription_t SUBSCRIPTIONS[] = {
+    {"display/config", 1},
+    {"display/mode", 1},
+    {"display/color", 1},
+    {"display/brightness", 1},
+    {"display/shader", 1},
+    {"display/pomodoro/work", 1},
+    {"display/pomodoro/short_break", 1},
+    {"display/pomodoro/long_break", 1},
+    {"display/pomodoro/reset", 1},
+    {"display/pomodoro/group", 1},
+    {"display/pomodoro/session", 1}, // our own echoes are dropped on arrival
+    {"display/ticker", 1},
+    {"display/history/query", 0},
+    {"display/ota/begin", 1},
+    {"display/ota/chunk", 0},
+    {"display/ota/abort", 1},
+};
 
 void
 on_mqtt_connect(bool session_present)
 {
-    auto id = mqtt::subscribe("display/#", 1); // all display notifications
-    if (!id) {
-        log_e("Error subscribing to MQTT topic");
-        ESP.restart();
+    for (const subscription_t& sub : SUBSCRIPTIONS) {
+        auto id = mqtt::subscribe(sub.topic, sub.qos);
+        if (!id) {
+            log_e("Error subscribing to MQTT topic %s", sub.topic);
+            ESP.restart();
+        }
     }
+
+    ota::on_mqtt_connect();
 }
 
 void
@@ -75,6 +139,29 @@ on_mqtt_message(
     AsyncMqttClientMessageProperties props
 )
 {
+    // Firmware chunks are binary and large, don't copy them
+    if (topic->startsWith("display/ota/")) {
+        ota::on_mqtt_message(topic->c_str() + MQTT_OTA_TOPIC_LEN, payload, length);
+        return;
+    }
+
+    // Neither are ticker messages, they're copied straight into the queue
+    if (*topic == "display/ticker") {
+        ticker::push(payload, length);
+        return;
+    }
+
+    // Config records are binary too
+    if (*topic == "display/config") {
+        settings::on_mqtt_message(payload, length);
+        return;
+    }
+
+    // Every session we publish comes back to us, drop those before copying them
+    if (*topic == "display/pomodoro/session" && pomodoro::is_own_echo(payload, length))
+        return;
+
+    heap_stats::scope heap_scope(heap_stats::TAG_STRING);
     String payload_str(payload, length);
     log_d("Payload: \"%s\"", payload_str.c_str());
 
@@ -90,14 +177,14 @@ on_mqtt_message(
             {
                 assert(subtopic == "mode");
 
-                long val = std::strtol(payload_str.c_str(), NULL, 10);
-                if (val <= DISP_MODE_NONE || val >= DISP_MODE_LAST) {
-                    log_e("Invalid display mode %d", val);
+                int8_t mode = modes::parse(payload_str.c_str());
+                if (mode < 0) {
+                    log_e("Invalid display mode %s", payload_str.c_str());
                     return;
                 }
 
-                display_mode = static_cast<display_mode_t>(val);
-                log_i("Updated display mode to %d", val);
+                display_mode = mode;
+                log_i("Updated display mode to %s", modes::MODES[mode].name);
 
                 break;
             }
@@ -112,15 +199,10 @@ on_mqtt_message(
                     return;
                 }
 
-                display_color[0] = (color >> 16) & 0xff; // red
-                display_color[1] = (color >> 8) & 0xff;  // green
-                display_color[2] = color & 0xff;         // blue
-
-                display_color_565 = MatrixPanel_I2S_DMA::color565(
-                    display_color[0], display_color[1], display_color[2]
-                );
+                set_display_color((color >> 16) & 0xff, (color >> 8) & 0xff, color & 0xff);
 
                 log_i("Updated display color to %#lx", color);
+                ++settings_version;
                 break;
             }
 
@@ -137,9 +219,23 @@ on_mqtt_message(
                 display_brightness = val;
                 log_i("Updated display brightness to %u", display_brightness);
 
+                ++settings_version;
                 break;
             }
 
+        case 's':
+            assert(subtopic == "shader");
+            shader::on_mqtt_message(payload_str);
+            ++settings_version;
+            break;
+
+        case 'h':
+            assert(subtopic.substring(0, 7) == "history");
+            history::on_mqtt_message(
+                subtopic.substring(8), local_tz.tzTime(timebase::now(), UTC_TIME)
+            );
+            break;
+
         case 'p':
             assert(subtopic.substring(0, 8) == "pomodoro");
             pomodoro::on_mqtt_message(subtopic, payload_str, props);
@@ -181,7 +277,9 @@ setup_led_matrix()
     };
 
     // Set up matrix config
-    HUB75_I2S_CFG config(MAT_RES_X, MAT_RES_Y, MAT_CHAIN, pins);
+    HUB75_I2S_CFG config(
+        panel_geometry::panel_width, panel_geometry::panel_height, panel_geometry::chain, pins
+    );
     config.clkphase = false;
     config.i2sspeed = HUB75_I2S_CFG::HZ_20M;
 
@@ -189,12 +287,16 @@ setup_led_matrix()
     config.double_buff = true;
 #endif
 
-    // Create display
+    // Create display, seeing what its buffers cost
+    size_t dma_free = heap_caps_get_free_size(MALLOC_CAP_DMA);
+
     display = new MatrixPanel_I2S_DMA(config);
     display->begin();
     display->setBrightness8(display_brightness); // 0 - 255
     display->clearScreen();
 
+    frame::begin(dma_free - heap_caps_get_free_size(MALLOC_CAP_DMA));
+
     // Enable bugfix
     display->cp437(true);
 }
@@ -203,6 +305,368 @@ setup_led_matrix()
 
 /*****************************************************************************/
 
+namespace {
+
+void
+on_stats_command(int argc, char** argv)
+{
+    if (argc != 2 || strcmp(argv[1], "reset") != 0) {
+        log_e("Usage: stats reset");
+        return;
+    }
+
+    text_layout::reset_stats();
+    heap_stats::reset_stats();
+    time_sync::reset_stats();
+    frame::reset_stats();
+    ticker::reset_stats();
+    anim::reset_stats();
+    stall::reset_stats();
+    idle::reset_stats();
+
+    log_i("Stats reset");
+}
+
+void
+on_stall_command(int argc, char** argv)
+{
+    if (argc == 1) {
+        stall::print_status();
+        return;
+    }
+
+    if (argc != 3 || strcmp(argv[1], "budget") != 0) {
+        log_e("Usage: stall [budget <ms>]");
+        return;
+    }
+
+    long budget_ms = strtol(argv[2], NULL, 10);
+    if (budget_ms <= 0) {
+        log_e("Invalid budget %s", argv[2]);
+        return;
+    }
+
+    stall::set_budget(budget_ms);
+    log_i("Loop stall budget set to %ld ms", budget_ms);
+}
+
+void
+setup_console()
+{
+    console::add("wifi", "print WiFi status", [](int, char**) {
+        wifi::print_status();
+    });
+
+    console::add("mqtt", "print MQTT status", [](int, char**) {
+        mqtt::print_status();
+    });
+
+    console::add("chip", "print chip info", [](int, char**) {
+        print_chip_debug_info();
+    });
+
+    console::add("ota", "print OTA status", [](int, char**) {
+        ota::print_status();
+    });
+
+    console::add("history", "print history stats", [](int, char**) {
+        history::print_status();
+    });
+
+    console::add("pomodoro", "print pomodoro group state", [](int, char**) {
+        pomodoro::print_status();
+    });
+
+    console::add("heap", "print heap stats", [](int, char**) {
+        heap_stats::print_status();
+    });
+
+    console::add("sync", "print time sync stats", [](int, char**) {
+        time_sync::print_status();
+    });
+
+    console::add("time", "print clock discipline state", [](int, char**) {
+        timebase::print_status();
+    });
+
+    console::add("ntp", "sync NTP now", [](int, char**) {
+        time_sync::request_ntp();
+    });
+
+    console::add("tz", "[location] look up a timezone", [](int argc, char** argv) {
+        time_sync::request_timezone(argc > 1 ? argv[1] : TIME_TIMEZONE);
+    });
+
+    console::add("frame", "print frame timing stats", [](int, char**) {
+        frame::print_status();
+    });
+
+    console::add("modes", "print display modes", [](int, char**) {
+        modes::print_status();
+    });
+
+    console::add("ticker", "print ticker frame rate and queue", [](int, char**) {
+        ticker::print_status();
+    });
+
+    console::add("config", "print config record and NVS stats", [](int, char**) {
+        settings::print_status();
+    });
+
+    console::add("stall", "[budget <ms>]: print loop stalls or set the budget", on_stall_command);
+
+    console::add("idle", "print idle time and wakeups", [](int, char**) {
+        idle::print_status();
+    });
+
+    console::add("metrics", "print metrics endpoint stats", [](int, char**) {
+        metrics::print_status();
+    });
+
+    console::add("anim", "print transition stats", [](int, char**) {
+        anim::print_status();
+    });
+
+    console::add("layout", "print text layout cache stats", [](int, char**) {
+        text_layout::stats_t stats = text_layout::stats();
+        log_i("Text layout cache: %lu hits, %lu misses", stats.hits, stats.misses);
+    });
+
+    console::add("restart", "restart the chip", [](int, char**) {
+        ESP.restart();
+    });
+
+    console::add("stats", "reset: reset all stats", on_stats_command);
+
+    bench::begin(display, &local_tz, &display_color_565);
+}
+
+} // namespace
+
+/*****************************************************************************/
+
+namespace {
+
+// What's on screen
+int8_t drawn_mode = DISP_MODE_NONE;
+uint32_t drawn_settings_version = 0;
+
+// When the loop next has something to do, see idle::wait_until()
+int64_t next_work_us = 0;
+
+/**
+ * The mode on screen, which is `display_mode` unless it needs MQTT and that's
+ * down.
+ */
+int8_t
+shown_mode()
+{
+    return modes::shown(display_mode, mqtt::stats().connected);
+}
+
+/**
+ * Whether the screen is out of date, for modes that aren't animating.
+ */
+bool
+needs_redraw(int8_t mode)
+{
+    return mode != drawn_mode || settings_version != drawn_settings_version;
+}
+
+constexpr uint8_t PERIOD_FIELDS[] = {
+    settings::FIELD_WORK,
+    settings::FIELD_SHORT_BREAK,
+    settings::FIELD_LONG_BREAK,
+};
+
+/**
+ * Frames per second `mode` needs right now, animations included.
+ */
+uint16_t
+frame_rate(int8_t mode)
+{
+    uint16_t fps = modes::frame_rate(mode);
+    return anim::active() ? max(fps, anim::FPS) : fps;
+}
+
+/**
+ * Apply a settings record, all of it at once.
+ */
+void
+apply_record(const settings::record_t& record)
+{
+    if (record.fields & settings::FIELD_MODE)
+        display_mode = record.mode;
+    if (record.fields & settings::FIELD_COLOR)
+        set_display_color(record.color[0], record.color[1], record.color[2]);
+    if (record.fields & settings::FIELD_BRIGHTNESS)
+        display_brightness = record.brightness;
+
+    for (int8_t period = 0; period < 3; ++period) {
+        if (record.fields & PERIOD_FIELDS[period])
+            pomodoro::set_minutes(period, record.minutes[period]);
+    }
+
+    // After the new durations, so the new period uses them
+    if (record.fields & settings::FIELD_RESET)
+        pomodoro::reset();
+
+    ++settings_version;
+}
+
+/**
+ * Apply display/config records received since the last frame.
+ */
+void
+apply_settings()
+{
+    settings::record_t record;
+    if (!settings::take(&record))
+        return;
+
+    apply_record(record);
+    log_i("Applied config record with fields %#x", record.fields);
+}
+
+/**
+ * Everything worth keeping across a reboot.
+ */
+settings::record_t
+current_settings()
+{
+    settings::record_t record{};
+
+    if (display_mode != DISP_MODE_NONE) {
+        record.fields |= settings::FIELD_MODE;
+        record.mode = display_mode;
+    }
+
+    record.fields |= settings::FIELD_COLOR | settings::FIELD_BRIGHTNESS;
+    memcpy(record.color, display_color, sizeof(record.color));
+    record.brightness = display_brightness;
+
+    for (int8_t period = 0; period < 3; ++period) {
+        record.fields |= PERIOD_FIELDS[period];
+        record.minutes[period] = pomodoro::minutes(period);
+    }
+
+    return record;
+}
+
+/**
+ * Draw `mode` into the back buffer, as of `now`, which is shown at `at_us`
+ * (`esp_timer_get_time()` time).
+ */
+void
+render(int8_t mode, time_t now, int64_t at_us)
+{
+    heap_stats::scope heap_scope(heap_stats::TAG_RENDER);
+    log_d("Updating display");
+
+    int64_t started_us = esp_timer_get_time();
+
+    // Start from scratch when switching modes or shaders
+    bool shader_changed = shader::apply();
+
+    uint16_t color = shader::color(
+        display_color_565, local_tz.tzTime(now, UTC_TIME), pomodoro::current_mode()
+    );
+
+    if (mode != drawn_mode || shader_changed) {
+        // Fade out what was on screen, as it would look now
+        if (mode != drawn_mode && mode != DISP_MODE_NONE && drawn_mode != DISP_MODE_NONE) {
+            Adafruit_GFX* outgoing = shader::target(anim::outgoing());
+
+            frame::invalidate();
+            outgoing->setTextColor(color);
+            modes::MODES[drawn_mode].draw({outgoing, &local_tz, now, at_us, color, true});
+
+            anim::start_crossfade(at_us);
+        }
+
+        frame::invalidate();
+        drawn_mode = mode;
+    }
+
+    drawn_settings_version = settings_version;
+
+    // Update settings
+    Adafruit_GFX* canvas = frame::target(display);
+    Adafruit_GFX* gfx = shader::target(anim::target(canvas, at_us));
+
+    gfx->setTextColor(color);
+    frame::set_brightness(anim::brightness(display_brightness, at_us));
+
+    // Update text
+    if (mode != DISP_MODE_NONE)
+        modes::MODES[mode].draw({gfx, &local_tz, now, at_us, color, false});
+
+    anim::finish(canvas);
+
+    frame::record_render(esp_timer_get_time() - started_us);
+}
+
+/**
+ * The second the next frame shows, and when it shows in `esp_timer_get_time()`
+ * time. At 1 fps frames land on the second boundary, faster ones keep a steady
+ * cadence from the last frame, and static ones (0 fps) show right away.
+ */
+time_t
+next_frame(uint16_t fps, int64_t* starts_at_us)
+{
+    static time_t last_second = 0;
+    static int64_t last_at_us = 0;
+
+    int64_t now_us = esp_timer_get_time();
+    int64_t wall_us = timebase::wall_us(now_us);
+
+    time_t now = wall_us / 1000000;
+
+    // Start over if the clock was stepped back
+    if (last_second > now + 1)
+        last_second = 0;
+
+    // Screens that don't animate go up right away
+    if (fps == 0) {
+        last_second = max(now, last_second);
+        last_at_us = now_us;
+
+        *starts_at_us = now_us;
+        return last_second;
+    }
+
+    if (fps > 1) {
+        int64_t period_us = 1000000 / fps;
+        int64_t at_us = last_at_us + period_us;
+
+        // Fell behind, skip ahead instead of trying to catch up
+        if (at_us < now_us) {
+            frame::record_dropped((now_us - at_us) / period_us + 1);
+            at_us = now_us + period_us;
+        }
+
+        last_at_us = at_us;
+        last_second = timebase::wall_us(at_us) / 1000000;
+
+        *starts_at_us = at_us;
+        return last_second;
+    }
+
+    // A flip that fired a hair early must not draw the same second twice
+    time_t next = max(now + 1, last_second + 1);
+    int64_t into_second_us = wall_us % 1000000;
+
+    last_second = next;
+    last_at_us = now_us + (1000000 - into_second_us) + (next - now - 1) * 1000000LL;
+
+    *starts_at_us = last_at_us;
+    return next;
+}
+
+} // namespace
+
+/*****************************************************************************/
+
 void
 setup()
 {
@@ -210,31 +674,53 @@ setup()
     Serial.begin(115200);
     Serial.setDebugOutput(true);
 
-    while (!Serial) // Wait until ready
-        ;
+    // Wait until ready, but don't hang without a host on USB serial
+    unsigned long serial_wait_ms = millis();
+    while (!Serial && millis() - serial_wait_ms < SERIAL_WAIT_MS)
+        delay(10);
+
+    stall::begin();
+    idle::begin();
 
     // Log information
     print_chip_debug_info();
 
-    // Set up eztime
+    // Set up eztime, syncing happens in the background
     ezt::setDebug(INFO);
+    time_sync::begin();
 
     // Set MQTT callbacks
     mqtt::set_connect_cb(on_mqtt_connect);
     mqtt::set_message_cb(on_mqtt_message);
 
+    // Load pomodoro history
+    history::begin();
+    pomodoro::begin();
+    ticker::begin();
+
+    // Pick up where we left off, before the first frame and without waiting
+    // for retained messages
+    settings::record_t saved;
+    if (settings::restore(&saved))
+        apply_record(saved);
+
     // Setup LED matrix
     setup_led_matrix();
 
+    // Setup serial commands
+    setup_console();
+
     // Test matrix
-    display->clearScreen();
-    for (size_t x = 0; x < MAT_RES_X; ++x) {
-        for (size_t y = 0; y < MAT_RES_Y; ++y) {
-            display->drawPixel(x, y, display->color565(x << 2, y << 3, 0));
+    Adafruit_GFX* gfx = frame::target(display);
+
+    gfx->fillScreen(0);
+    for (size_t x = 0; x < panel_geometry::width; ++x) {
+        for (size_t y = 0; y < panel_geometry::height; ++y) {
+            gfx->drawPixel(x, y, display->color565(x << 2, y << 3, 0));
         }
     }
 
-    display->flipDMABuffer();
+    frame::flip(display);
 
     // Start connections
     connections::begin(&should_reconnect_wifi, &should_reconnect_mqtt);
@@ -243,96 +729,134 @@ setup()
 void
 loop()
 {
+    stall::loop_started();
+
+    // Sleep until there's something to do
+    stall::enter(stall::PHASE_IDLE);
+    idle::wait_until(next_work_us);
+
     // Run callbacks
+    stall::enter(stall::PHASE_CONNECT);
+    next_work_us = 0; // until we know better
+
     if (should_reconnect_wifi) {
+        heap_stats::scope heap_scope(heap_stats::TAG_WIFI);
+
         wifi::connect();
         timezones_need_refresh = true;
     }
 
-    if (should_reconnect_mqtt)
+    if (should_reconnect_mqtt) {
+        heap_stats::scope heap_scope(heap_stats::TAG_MQTT);
         mqtt::connect();
+    }
 
-    // Process commands
-    while (Serial.available()) {
-        switch (Serial.read()) {
-            case 'w':
-                wifi::print_status();
-                break;
-
-            case 'm':
-                mqtt::print_status();
-                break;
-
-            case 's':
-                print_chip_debug_info();
-                break;
-
-            case 'r':
-                ESP.restart();
-                __builtin_unreachable();
+    // Restart into new firmware if we got some
+    stall::enter(stall::PHASE_HOUSEKEEPING);
+    ota::poll();
 
-            case 'u':
-                local_tz.setLocation("Europe/Belgrade");
-                break;
+    // Between frames, so a config record shows up all in one frame
+    apply_settings();
 
-            case 'c':
-                local_tz.setLocation(TIME_TIMEZONE);
-                break;
+    // Write out old history and settings that stopped changing
+    history::poll();
+    settings::poll(current_settings());
 
-            case 't':
-                ezt::updateNTP();
-                break;
+    // Publish pomodoro transitions, outside of drawing
+    pomodoro::poll();
 
-            default:
-                break;
-        }
-    }
+    // Keep track of the heap, MQTT traffic and ourselves
+    heap_stats::poll();
+    mqtt::poll();
+    stall::poll();
+    metrics::poll();
 
-    // Only do the rest if we have WiFi
-    if (WiFi.status() != WL_CONNECTED)
-        return;
+    // Process commands
+    stall::enter(stall::PHASE_CONSOLE);
+    console::poll();
 
-    // Refresh timezones
-    if (timezones_need_refresh) {
+    // Refresh timezones once we have WiFi, this happens in the background
+    stall::enter(stall::PHASE_TIMEZONE);
+    if (timezones_need_refresh && WiFi.status() == WL_CONNECTED) {
         log_i("Refreshing timezones");
-        local_tz.setLocation(TIME_TIMEZONE);
 
-        log_i("Timezone refresh completed");
+        time_sync::request_ntp();
+        time_sync::request_timezone(TIME_TIMEZONE);
+
         timezones_need_refresh = false;
     }
 
-    // Run ezt events
-    ezt::events();
+    // Pick up finished syncs and run ezt events
+    stall::enter(stall::PHASE_EZTIME);
+    {
+        heap_stats::scope heap_scope(heap_stats::TAG_EZTIME);
 
-    // Update display
-    if (ezt::secondChanged()) {
-        log_i("Updating display");
-
-        // Update settings
-        display->setTextColor(display_color_565);
-        display->setBrightness8(display_brightness);
+        time_sync::apply(&local_tz);
+        ezt::events();
+    }
 
-        // Update text
-        switch (display_mode) {
-            case DISP_MODE_NONE:
-                break;
+    // Modes that show the time wait for NTP, the sync wakes us. Anything else,
+    // like a mode restored from NVS, goes up right away. Without MQTT, the
+    // ticker gives way to the clock.
+    int8_t mode = shown_mode();
 
-            case DISP_MODE_CLOCK:
-                matrix_clock::draw(display, &local_tz);
-                break;
+    if (!modes::can_draw(mode, timebase::is_set())) {
+        next_work_us = idle::NO_DEADLINE;
+        return;
+    }
 
-            case DISP_MODE_POMODORO:
-                pomodoro::draw(display, &local_tz);
-                break;
+    // Only draw as often as the mode needs, static screens only when they change
+    uint16_t fps = frame_rate(mode);
+    bool wanted = fps > 0 || needs_redraw(mode);
 
-            default:
-                log_e("Invalid display mode");
-                abort();
+#ifdef MAT_DOUBLE_BUFF
+    // Draw the next frame while this one is shown, so it flips in on time
+    if (!frame::flip_pending()) {
+        stall::enter(stall::PHASE_FLIP);
+        frame::apply_brightness(display);
+
+        if (wanted) {
+            int64_t starts_at_us;
+            time_t next = next_frame(fps, &starts_at_us);
+
+            stall::enter(stall::PHASE_RENDER);
+            render(mode, next, starts_at_us);
+
+            stall::enter(stall::PHASE_FLIP);
+            if (fps > 0)
+                frame::schedule_flip(display, starts_at_us);
+            else
+                frame::flip(display);
         }
+    }
 
-#ifdef MAT_DOUBLE_BUFF
-        // Show the updates
-        display->flipDMABuffer();
-#endif
+    // The flip wakes us to draw the frame after it, static screens wait for a
+    // change
+    mode = shown_mode();
+    next_work_us = idle::next_work_us(
+        frame::flip_pending(), frame_rate(mode), needs_redraw(mode), 0
+    );
+#else
+    // Drawing is showing without a back buffer, so wait until it's time
+    static int64_t frame_at_us = 0;
+    static time_t frame_second = 0;
+
+    if (!frame_at_us && wanted)
+        frame_second = next_frame(fps, &frame_at_us);
+
+    if (frame_at_us && esp_timer_get_time() >= frame_at_us) {
+        stall::enter(stall::PHASE_RENDER);
+        render(mode, frame_second, frame_at_us);
+
+        stall::enter(stall::PHASE_FLIP);
+        frame::flip(display);
+        frame::apply_brightness(display);
+
+        frame_at_us = 0;
     }
+
+    // Wait for the frame, or for a change on static screens
+    mode = shown_mode();
+    next_work_us = idle::next_work_us(false, frame_rate(mode), needs_redraw(mode), frame_at_us);
+#endif
 }
@@ -0,0 +1,331 @@
+#include "metrics.hpp"
+
+#include "config.h"
+#include "connections.hpp"
+#include "frame.hpp"
+#include "heap_stats.hpp"
+#include "idle.hpp"
+#include "pomodoro.hpp"
+#include "stall.hpp"
+
+#include <AsyncTCP.h>
+#include <WiFi.h>
+#include <esp_timer.h>
+
+// Older configs don't set one
+#ifndef METRICS_PORT
+#define METRICS_PORT 9100
+#endif
+
+namespace {
+
+using metrics::RESPONSE_LEN;
+using metrics::response_t;
+
+constexpr char OK_HEADER[] = "HTTP/1.0 200 OK\r\n"
+                             "Content-Type: text/plain; version=0.0.4\r\n"
+                             "Connection: close\r\n\r\n";
+constexpr char NOT_FOUND[] = "HTTP/1.0 404 Not Found\r\nConnection: close\r\n\r\n";
+constexpr char BUSY[] = "HTTP/1.0 503 Service Unavailable\r\nConnection: close\r\n\r\n";
+constexpr char TOO_LONG[] = "HTTP/1.0 500 Internal Server Error\r\nConnection: close\r\n\r\n";
+
+AsyncServer* server = nullptr;
+
+// The response being sent, and who to. Only touched from the AsyncTCP task.
+response_t response{};
+size_t response_sent = 0;
+AsyncClient* serving = nullptr;
+
+struct {
+    uint32_t scrapes;
+    uint32_t not_found;
+    uint32_t busy;
+    uint32_t overflows;
+    uint32_t build_us; // last scrape
+    uint32_t max_build_us;
+} stats{};
+
+void
+counter(const char* name, const char* help, uint32_t value)
+{
+    metrics::counter(&response, name, help, value);
+}
+
+void
+counter_us(const char* name, const char* help, int64_t value_us)
+{
+    metrics::counter_us(&response, name, help, value_us);
+}
+
+void
+gauge(const char* name, const char* help, double value)
+{
+    metrics::gauge(&response, name, help, value);
+}
+
+void
+build_frame()
+{
+    frame::flip_stats_t s = frame::flip_stats();
+
+    counter("display_frames_rendered_total", "Frames drawn.", s.rendered);
+    counter_us("display_frame_render_seconds_total", "Time spent drawing frames.", s.render_us);
+    counter("display_frames_flipped_total", "Frames flipped in on a timer.", s.flips);
+    counter("display_frames_late_total", "Frames ready after their deadline.", s.late);
+    counter("display_frames_dropped_total", "Frames skipped to catch up.", s.dropped);
+    counter_us(
+        "display_frame_flip_skew_seconds_total", "Time between flip deadlines and flips.", s.skew_us
+    );
+
+    frame::push_stats_t p = frame::push_stats();
+
+    gauge("display_frame_dma_bytes", "DMA memory of the display's buffers.", frame::dma_bytes());
+    counter("display_frame_pushes_total", "Single buffered partial updates.", p.pushes);
+    counter("display_frame_pushed_pixels_total", "Pixels copied by partial updates.", p.pixels);
+    counter_us(
+        "display_frame_push_seconds_total", "Time spent copying partial updates.", p.push_us
+    );
+}
+
+void
+build_loop()
+{
+    stall::stats_t s = stall::stats();
+
+    metrics::histogram_ms(
+        &response,
+        "display_loop_duration_seconds",
+        "Time taken by loop() iterations.",
+        stall::BUCKET_MS,
+        std::size(stall::BUCKET_MS),
+        s.buckets,
+        s.total_us
+    );
+
+    idle::stats_t idle_stats = idle::stats();
+
+    counter_us(
+        "display_loop_idle_seconds_total", "Time the loop spent waiting.", idle_stats.idle_us
+    );
+    counter("display_loop_wakeups_total", "Waits that ended.", idle_stats.wakeups);
+
+    metrics::describe(
+        &response,
+        "display_loop_stalls_total",
+        "counter",
+        "Iterations over budget, by slowest phase."
+    );
+    for (uint8_t i = 0; i < stall::PHASE_LAST; ++i) {
+        stall::phase_t phase = static_cast<stall::phase_t>(i);
+        metrics::append(
+            &response,
+            "display_loop_stalls_total{phase=\"%s\"} %lu\n",
+            stall::phase_name(phase),
+            s.stalls[i]
+        );
+    }
+}
+
+void
+build_heap()
+{
+    gauge("display_heap_free_bytes", "Free heap.", ESP.getFreeHeap());
+    gauge("display_heap_min_free_bytes", "Lowest free heap since boot.", ESP.getMinFreeHeap());
+    gauge("display_heap_largest_block_bytes", "Largest free block.", ESP.getMaxAllocHeap());
+
+    if (!heap_stats::ENABLED)
+        return;
+
+    gauge(
+        "display_heap_live_partial",
+        "Whether blocks went untracked, so live bytes are low.",
+        heap_stats::partial()
+    );
+
+    metrics::describe(&response, "display_heap_live_bytes", "gauge", "Heap in use, by subsystem.");
+    for (uint8_t i = 0; i < heap_stats::TAG_LAST; ++i) {
+        heap_stats::tag_t tag = static_cast<heap_stats::tag_t>(i);
+        metrics::append(
+            &response,
+            "display_heap_live_bytes{subsystem=\"%s\"} %lu\n",
+            heap_stats::tag_name(tag),
+            heap_stats::get(tag).live_bytes
+        );
+    }
+}
+
+void
+build_network()
+{
+    bool wifi_up = WiFi.isConnected();
+
+    gauge("display_wifi_connected", "Whether WiFi is connected.", wifi_up);
+    if (wifi_up)
+        gauge("display_wifi_rssi_dbm", "WiFi signal strength.", WiFi.RSSI());
+
+    mqtt::stats_t s = mqtt::stats();
+
+    gauge("display_mqtt_connected", "Whether MQTT is connected.", s.connected);
+    counter("display_mqtt_connects_total", "MQTT connections made.", s.connects);
+    counter("display_mqtt_disconnects_total", "MQTT connections lost.", s.disconnects);
+    counter("display_mqtt_messages_total", "MQTT messages received.", s.messages);
+    counter("display_mqtt_round_trips_total", "MQTT acks sent and received.", s.round_trips);
+}
+
+void
+build()
+{
+    int64_t started_us = esp_timer_get_time();
+
+    metrics::clear(&response);
+    metrics::append(&response, "%s", OK_HEADER);
+
+    gauge("display_uptime_seconds", "Time since boot.", started_us / 1e6);
+
+    build_frame();
+    build_loop();
+    build_heap();
+    build_network();
+
+    gauge(
+        "display_pomodoro_mode", "0 work, 1 short break, 2 long break.", pomodoro::current_mode()
+    );
+    gauge(
+        "display_pomodoros_completed", "Pomodoros since the last reset.", pomodoro::completed()
+    );
+
+    // About ourselves, as of the last scrape
+    counter("display_metrics_scrapes_total", "Scrapes served.", stats.scrapes);
+    gauge(
+        "display_metrics_build_seconds", "Time the last scrape took to build.", stats.build_us / 1e6
+    );
+
+    stats.build_us = esp_timer_get_time() - started_us;
+    stats.max_build_us = max(stats.max_build_us, stats.build_us);
+}
+
+/**
+ * Queue as much of the response as the client has room for.
+ */
+void
+send_more(AsyncClient* client)
+{
+    size_t len = min(client->space(), response.len - response_sent);
+    if (len) {
+        client->add(response.text + response_sent, len);
+        client->send();
+
+        response_sent += len;
+    }
+
+    // Everything's been copied out, the buffer is free
+    if (response_sent == response.len) {
+        serving = nullptr;
+        client->close();
+    }
+}
+
+void
+reply(AsyncClient* client, const char* text, size_t len)
+{
+    client->write(text, len);
+    client->close();
+}
+
+void
+on_data(void*, AsyncClient* client, void* data, size_t len)
+{
+    // The request line is all we need, and it's in the first packet
+    if (!metrics::is_scrape(static_cast<const char*>(data), len)) {
+        ++stats.not_found;
+        reply(client, NOT_FOUND, sizeof(NOT_FOUND) - 1);
+        return;
+    }
+
+    if (serving) {
+        ++stats.busy;
+        reply(client, BUSY, sizeof(BUSY) - 1);
+        return;
+    }
+
+    build();
+
+    if (response.overflowed) {
+        log_e("Metrics don't fit in %u bytes", RESPONSE_LEN);
+
+        ++stats.overflows;
+        reply(client, TOO_LONG, sizeof(TOO_LONG) - 1);
+        return;
+    }
+
+    ++stats.scrapes;
+
+    serving = client;
+    response_sent = 0;
+    send_more(client);
+}
+
+void
+on_ack(void*, AsyncClient* client, size_t, uint32_t)
+{
+    if (client == serving)
+        send_more(client);
+}
+
+void
+on_disconnect(void*, AsyncClient* client)
+{
+    if (client == serving)
+        serving = nullptr;
+
+    // The server allocated it for us
+    delete client;
+}
+
+void
+on_client(void*, AsyncClient* client)
+{
+    client->onData(on_data);
+    client->onAck(on_ack);
+    client->onDisconnect(on_disconnect);
+}
+
+} // namespace
+
+namespace metrics {
+
+void
+poll() noexcept
+{
+    // The TCP/IP stack needs to be up before we can listen
+    if (server || !WiFi.isConnected())
+        return;
+
+    server = new AsyncServer(METRICS_PORT);
+    server->onClient(on_client, nullptr);
+    server->begin();
+
+    log_i("Serving metrics on port %u", METRICS_PORT);
+}
+
+void
+print_status() noexcept
+{
+    log_i(
+        "Metrics: %lu scrapes, %lu not found, %lu busy, %lu too long",
+        stats.scrapes,
+        stats.not_found,
+        stats.busy,
+        stats.overflows
+    );
+
+    log_i(
+        "Last response %u/%u bytes, built in %lu us, max %lu us",
+        response.len,
+        RESPONSE_LEN,
+        stats.build_us,
+        stats.max_build_us
+    );
+}
+
+} // namespace metrics
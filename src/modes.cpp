@@ -0,0 +1,64 @@
+#include "modes.hpp"
+
+namespace modes {
+
+int8_t
+parse(const char* str) noexcept
+{
+    for (int8_t i = 0; i < COUNT; ++i) {
+        if (strcmp(str, MODES[i].name) == 0)
+            return i;
+    }
+
+    char* end;
+    long val = strtol(str, &end, 10);
+
+    return end != str && val >= 0 && val < COUNT ? val : -1;
+}
+
+uint16_t
+frame_rate(int8_t mode) noexcept
+{
+    if (mode < 0 || mode >= COUNT)
+        return 0;
+
+    const mode_t& m = MODES[mode];
+    return !m.animating || m.animating() ? m.fps : 0;
+}
+
+int8_t
+shown(int8_t mode, bool mqtt_connected) noexcept
+{
+    if (mode < 0 || mode >= COUNT || mqtt_connected || !MODES[mode].needs_network)
+        return mode;
+
+    // Let a message that's already in finish scrolling
+    const mode_t& m = MODES[mode];
+    return m.animating && m.animating() ? mode : FALLBACK;
+}
+
+bool
+can_draw(int8_t mode, bool time_set) noexcept
+{
+    return time_set || (mode >= 0 && mode < COUNT && !MODES[mode].needs_time);
+}
+
+void
+print_status() noexcept
+{
+    for (int8_t i = 0; i < COUNT; ++i) {
+        const mode_t& m = MODES[i];
+
+        log_i(
+            "Mode %d: %s, %u fps%s%s%s",
+            i,
+            m.name,
+            m.fps,
+            m.animating ? " while animating" : "",
+            m.needs_network ? ", needs network" : "",
+            m.needs_time ? ", needs time" : ""
+        );
+    }
+}
+
+} // namespace modes
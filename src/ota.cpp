@@ -0,0 +1,306 @@
+#include "ota.hpp"
+
+#include "config.h"
+
+#include "connections.hpp"
+
+#include <esp_ota_ops.h>
+#include <mbedtls/md.h>
+#include <mbedtls/sha256.h>
+
+#include <cstring>
+
+// Older configs don't set one, and without a key nobody gets to flash us
+#ifndef OTA_KEY
+#define OTA_KEY ""
+#endif
+
+namespace {
+
+constexpr unsigned long RESTART_DELAY_MS = 2 * 1000; // let the final status go out
+
+/**
+ * Writes images into whichever OTA partition we aren't running from.
+ */
+class partition_writer : public ota::flash_writer_t {
+public:
+    size_t
+    capacity() override
+    {
+        partition_ = esp_ota_get_next_update_partition(nullptr);
+        return partition_ ? partition_->size : 0;
+    }
+
+    const char*
+    begin(size_t) override
+    {
+        // Erase as we go rather than all at once up front
+        esp_err_t err = esp_ota_begin(partition_, OTA_WITH_SEQUENTIAL_WRITES, &handle_);
+        if (err != ESP_OK)
+            return esp_err_to_name(err);
+
+        mbedtls_sha256_init(&sha_ctx_);
+        mbedtls_sha256_starts_ret(&sha_ctx_, 0);
+
+        return nullptr;
+    }
+
+    const char*
+    write(const uint8_t* data, size_t len) override
+    {
+        esp_err_t err = esp_ota_write(handle_, data, len);
+        if (err != ESP_OK)
+            return esp_err_to_name(err);
+
+        mbedtls_sha256_update_ret(&sha_ctx_, data, len);
+        return nullptr;
+    }
+
+    void
+    digest(uint8_t* sha) override
+    {
+        mbedtls_sha256_finish_ret(&sha_ctx_, sha);
+    }
+
+    const char*
+    commit() override
+    {
+        mbedtls_sha256_free(&sha_ctx_);
+
+        // Also validates the image
+        esp_err_t err = esp_ota_end(handle_);
+        if (err == ESP_OK)
+            err = esp_ota_set_boot_partition(partition_);
+
+        return err == ESP_OK ? nullptr : esp_err_to_name(err);
+    }
+
+    void
+    abort() override
+    {
+        esp_ota_abort(handle_);
+        mbedtls_sha256_free(&sha_ctx_);
+    }
+
+    const char*
+    label() const
+    {
+        return partition_ ? partition_->label : "none";
+    }
+
+private:
+    const esp_partition_t* partition_ = nullptr;
+    esp_ota_handle_t handle_ = 0;
+    mbedtls_sha256_context sha_ctx_;
+};
+
+// Status
+partition_writer writer;
+ota::session_t session{&writer, ota::STATE_IDLE, 0, {}, 0, 0, nullptr};
+
+unsigned long started_ms = 0;
+unsigned long finished_ms = 0;
+
+// Helpers
+const char*
+state_string()
+{
+    switch (session.state) {
+        case ota::STATE_IDLE:
+            return "idle";
+        case ota::STATE_RECEIVING:
+            return "receiving";
+        case ota::STATE_DONE:
+            return "done";
+        case ota::STATE_FAILED:
+        default:
+            return "failed";
+    }
+}
+
+float
+throughput_kbps()
+{
+    unsigned long end_ms = session.state == ota::STATE_RECEIVING ? millis() : finished_ms;
+    unsigned long elapsed_ms = end_ms - started_ms;
+
+    return elapsed_ms ? session.bytes_written / 1024.0f / (elapsed_ms / 1000.0f) : 0;
+}
+
+void
+publish_status()
+{
+    char status[64];
+    int len = snprintf(
+        status,
+        sizeof(status),
+        "%s %lu %zu %.1f",
+        state_string(),
+        static_cast<unsigned long>(session.next_seq),
+        session.bytes_written,
+        throughput_kbps()
+    );
+
+    auto id = mqtt::publish("display/ota/status", 0, false, status, len);
+    if (!id)
+        log_w("Error publishing OTA status to MQTT");
+}
+
+/**
+ * Whether `mac` is our key's HMAC-SHA256 of an image hash.
+ */
+bool
+authentic(const uint8_t* sha, const uint8_t* mac)
+{
+    constexpr size_t KEY_LEN = sizeof(OTA_KEY) - 1;
+    if (KEY_LEN == 0) {
+        log_e("No OTA_KEY in config.h, refusing updates");
+        return false;
+    }
+
+    uint8_t expected[ota::SHA256_LEN];
+    int err = mbedtls_md_hmac(
+        mbedtls_md_info_from_type(MBEDTLS_MD_SHA256),
+        reinterpret_cast<const uint8_t*>(OTA_KEY),
+        KEY_LEN,
+        sha,
+        ota::SHA256_LEN,
+        expected
+    );
+    if (err != 0)
+        return false;
+
+    // Don't leak how much of the MAC matched through timing
+    uint8_t diff = 0;
+    for (size_t i = 0; i < ota::SHA256_LEN; ++i)
+        diff |= expected[i] ^ mac[i];
+
+    return diff == 0;
+}
+
+/**
+ * Log, timestamp and acknowledge whatever happened to the session.
+ */
+void
+report(ota::event_t event)
+{
+    switch (event) {
+        case ota::EVENT_NONE:
+            return;
+
+        case ota::EVENT_ACK:
+            break;
+
+        case ota::EVENT_REWIND:
+            if (session.state == ota::STATE_RECEIVING) {
+                log_w(
+                    "Got OTA chunk out of order, expected %lu",
+                    static_cast<unsigned long>(session.next_seq)
+                );
+            }
+            break;
+
+        case ota::EVENT_STARTED:
+            started_ms = millis();
+            log_i(
+                "Starting OTA of %zu bytes to partition %s",
+                session.image_size,
+                writer.label()
+            );
+            break;
+
+        case ota::EVENT_RESUMED:
+            log_i("Resuming OTA at chunk %lu", static_cast<unsigned long>(session.next_seq));
+            break;
+
+        case ota::EVENT_DONE:
+            finished_ms = millis();
+            log_i("OTA completed at %.1f KB/s, restarting", throughput_kbps());
+            break;
+
+        case ota::EVENT_FAILED:
+            finished_ms = millis();
+            log_e("OTA failed: %s", session.error);
+            break;
+    }
+
+    publish_status();
+}
+
+void
+on_begin(const uint8_t* payload, size_t length)
+{
+    char args[160];
+    if (length >= sizeof(args)) {
+        log_e("OTA begin message too long");
+        return;
+    }
+
+    memcpy(args, payload, length);
+    args[length] = '\0';
+
+    size_t size;
+    uint8_t sha[ota::SHA256_LEN];
+    uint8_t mac[ota::SHA256_LEN];
+
+    if (!ota::parse_begin(args, &size, sha, mac)) {
+        log_e("Invalid OTA begin message \"%s\"", args);
+        return;
+    }
+
+    // Anyone on the broker can send us an image, only take ones signed with our key
+    if (!authentic(sha, mac)) {
+        log_e("OTA image isn't signed with our key, ignoring it");
+        return;
+    }
+
+    report(ota::begin(&session, size, sha));
+}
+
+} // namespace
+
+namespace ota {
+
+void
+on_mqtt_message(const char* subtopic, const uint8_t* payload, size_t length) noexcept
+{
+    if (strcmp(subtopic, "chunk") == 0)
+        report(ota::chunk(&session, payload, length));
+    else if (strcmp(subtopic, "begin") == 0)
+        on_begin(payload, length);
+    else if (strcmp(subtopic, "abort") == 0)
+        report(ota::fail(&session, "Aborted"));
+    else if (strcmp(subtopic, "status") != 0) // our own
+        log_w("Invalid OTA topic %s", subtopic);
+}
+
+void
+on_mqtt_connect() noexcept
+{
+    if (session.state == ota::STATE_RECEIVING)
+        publish_status();
+}
+
+void
+poll() noexcept
+{
+    if (session.state == ota::STATE_DONE && millis() - finished_ms > RESTART_DELAY_MS) {
+        log_i("Restarting into new firmware");
+        ESP.restart();
+    }
+}
+
+void
+print_status() noexcept
+{
+    log_i(
+        "OTA %s: chunk %lu, %zu/%zu bytes, %.1f KB/s",
+        state_string(),
+        static_cast<unsigned long>(session.next_seq),
+        session.bytes_written,
+        session.image_size,
+        throughput_kbps()
+    );
+}
+
+} // namespace ota
@@ -1,6 +1,14 @@
 #include "pomodoro.hpp"
 
+#include "anim.hpp"
+#include "config.h"
 #include "connections.hpp"
+#include "frame.hpp"
+#include "geometry.hpp"
+#include "history.hpp"
+#include "progress.hpp"
+#include "seven_seg.hpp"
+#include "timebase.hpp"
 #include "utils.hpp"
 
 #include <cstdint>
@@ -14,40 +22,76 @@ enum pomo_mode_t : int8_t {
 
 namespace {
 
+using pomodoro::session_id_t;
+using pomodoro::session_t;
+
 // Config
 uint8_t work_minutes = 25;
 uint8_t short_break_minutes = 15;
 uint8_t long_break_minutes = 5;
 
+constexpr uint8_t PULSE_SECONDS = 5;
+
 // Status
 pomo_mode_t mode = POMO_MODE_NONE;
-size_t time_remaining = work_minutes * 60;
+time_t deadline = 0;         // UTC time the current period ends
+uint32_t period_seconds = 0; // length of the current period
 
-uint8_t blinks_remaining = 0;
 size_t num_pomodoros_completed = 0;
 
+// Set when the period changes, published from poll() so MQTT never holds up a
+// frame
+bool transition_pending = false;
+
+// Group mode, where every display shares the session on display/pomodoro/session
+pomodoro::group_t group{};
+
+// Set from the MQTT task, applied by poll() so drawing never sees half of it
+struct pending_t {
+    int16_t minutes[3]; // per period, -1 if unchanged
+    int8_t group;       // -1 if unchanged
+    bool reset;
+    bool has_session;
+    session_t session; // newest one received
+};
+
+constexpr pending_t NO_PENDING{{-1, -1, -1}, -1, false, false, {}};
+
+portMUX_TYPE pending_mux = portMUX_INITIALIZER_UNLOCKED;
+pending_t pending = NO_PENDING;
+
+// Our own sessions that came back to us, dropped unparsed
+uint32_t echoes_dropped = 0;
+
+// Transition latency, from a remote writer publishing to us adopting it
+uint32_t adopted_sessions = 0;
+uint64_t total_latency_ms = 0;
+int64_t max_latency_ms = 0;
+
 // Helpers
 void
-on_work_completed()
+start_period(pomo_mode_t new_mode, uint8_t minutes, time_t start)
+{
+    mode = new_mode;
+    period_seconds = minutes * 60;
+    deadline = start + period_seconds;
+}
+
+void
+on_work_completed(time_t start)
 {
     ++num_pomodoros_completed;
 
-    if (num_pomodoros_completed % 4 == 0) {
-        // Long break every 4th pomodoro
-        mode = POMO_MODE_LONG_BREAK;
-        time_remaining = long_break_minutes * 60;
-    }
-    else {
-        mode = POMO_MODE_SHORT_BREAK;
-        time_remaining = short_break_minutes * 60;
-    }
+    if (num_pomodoros_completed % 4 == 0) // Long break every 4th pomodoro
+        start_period(POMO_MODE_LONG_BREAK, long_break_minutes, start);
+    else
+        start_period(POMO_MODE_SHORT_BREAK, short_break_minutes, start);
 }
 
 void
-on_break_completed()
+on_break_completed(time_t start)
 {
-    mode = POMO_MODE_WORK;
-    time_remaining = work_minutes * 60;
+    start_period(POMO_MODE_WORK, work_minutes, start);
 }
 
 const char*
@@ -67,6 +111,21 @@ mode_string()
     }
 }
 
+history::kind_t
+history_kind()
+{
+    switch (mode) {
+        case POMO_MODE_SHORT_BREAK:
+            return history::KIND_SHORT_BREAK;
+
+        case POMO_MODE_LONG_BREAK:
+            return history::KIND_LONG_BREAK;
+
+        default:
+            return history::KIND_WORK;
+    }
+}
+
 void
 publish_count()
 {
@@ -81,14 +140,94 @@ publish_count()
         log_w("Error publishing count message to MQTT");
 }
 
+void
+publish_session()
+{
+    if (!group.enabled)
+        return;
+
+    session_id_t session_id = pomodoro::next_id(&group);
+
+    char session_str[96];
+    int len = snprintf(
+        session_str,
+        sizeof(session_str),
+        "%lu %lu %d %lld %lu %lu %lld",
+        static_cast<unsigned long>(session_id.version),
+        static_cast<unsigned long>(session_id.origin),
+        mode,
+        static_cast<long long>(deadline),
+        static_cast<unsigned long>(period_seconds),
+        static_cast<unsigned long>(num_pomodoros_completed),
+        static_cast<long long>(timebase::now_ms())
+    );
+
+    auto id = mqtt::publish("display/pomodoro/session", 1, true, session_str, len);
+    if (!id)
+        log_w("Error publishing session to MQTT");
+}
+
+void
+adopt_session(const session_t& session)
+{
+    mode = static_cast<pomo_mode_t>(session.mode);
+    deadline = session.deadline;
+    period_seconds = session.period_seconds;
+    num_pomodoros_completed = session.count;
+
+    if (session.id.origin != group.node_id) {
+        int64_t latency_ms = timebase::now_ms() - session.sent_ms;
+
+        ++adopted_sessions;
+        total_latency_ms += max(latency_ms, static_cast<int64_t>(0));
+        max_latency_ms = max(max_latency_ms, latency_ms);
+
+        log_i(
+            "Adopted session %lu from %08lx, %lld ms after it was sent",
+            session.id.version,
+            session.id.origin,
+            latency_ms
+        );
+    }
+}
+
+void
+on_session(const session_t& session)
+{
+    if (pomodoro::merge(&group, session))
+        adopt_session(session);
+}
+
+void
+set_group_mode(bool enabled)
+{
+    if (enabled == group.enabled)
+        return;
+
+    log_i("Group mode %s", enabled ? "on" : "off");
+
+    if (!enabled) {
+        group.enabled = false;
+        return;
+    }
+
+    // Join whatever the group is doing, or start it off with our session
+    const session_t* latest = pomodoro::join(&group);
+    if (latest)
+        adopt_session(*latest);
+    else if (mode != POMO_MODE_NONE)
+        publish_session();
+}
+
 void
 reset_state()
 {
-    mode = POMO_MODE_WORK;
-    time_remaining = work_minutes * 60;
+    start_period(POMO_MODE_WORK, work_minutes, timebase::now());
 
     num_pomodoros_completed = 0;
-    publish_count();
+
+    // Like any other transition, this may be happening in the middle of a frame
+    transition_pending = true;
 }
 
 } // namespace
@@ -102,6 +241,24 @@ on_mqtt_message(
 {
     String pomo_topic = subtopic.substring(9);
 
+    // Sessions aren't a single number
+    if (pomo_topic == "session") {
+        session_t session;
+        if (!parse_session(payload.c_str(), &session)) {
+            log_e("Invalid pomodoro session \"%s\"", payload.c_str());
+            return;
+        }
+
+        portENTER_CRITICAL(&pending_mux);
+        if (!pending.has_session || session.id > pending.session.id) {
+            pending.session = session;
+            pending.has_session = true;
+        }
+        portEXIT_CRITICAL(&pending_mux);
+
+        return;
+    }
+
     // Parse value
     long val = strtol(payload.c_str(), NULL, 10);
     if (val < 0 || val > UINT8_MAX) {
@@ -110,68 +267,110 @@ on_mqtt_message(
     }
 
     // Decide what to do
-    switch (pomo_topic[0]) {
+    char kind = pomo_topic[0];
+    int8_t period = POMO_MODE_NONE;
+
+    switch (kind) {
         case 'w':
             assert(pomo_topic == "work");
-
-            work_minutes = static_cast<uint8_t>(val);
-            log_i("Set work minutes to %u", work_minutes);
-
+            period = POMO_MODE_WORK;
             break;
 
         case 's':
             assert(pomo_topic == "short_break");
-
-            short_break_minutes = static_cast<uint8_t>(val);
-            log_i("Set short break minutes to %u", short_break_minutes);
-
+            period = POMO_MODE_SHORT_BREAK;
             break;
 
         case 'l':
             assert(pomo_topic == "long_break");
+            period = POMO_MODE_LONG_BREAK;
+            break;
 
-            long_break_minutes = static_cast<uint8_t>(val);
-            log_i("Set long break minutes to %u", long_break_minutes);
-
+        case 'g':
+            assert(pomo_topic == "group");
             break;
 
         case 'r':
             assert(pomo_topic == "reset");
-
-            reset_state();
             break;
 
         default:
             log_w("Invalid pomodoro topic %s", pomo_topic.c_str());
-            break;
+            return;
     }
+
+    // Applied by poll(), between frames
+    portENTER_CRITICAL(&pending_mux);
+
+    if (period != POMO_MODE_NONE)
+        pending.minutes[period] = val;
+    else if (kind == 'g')
+        pending.group = val != 0;
+    else
+        pending.reset = true;
+
+    portEXIT_CRITICAL(&pending_mux);
 }
 
-void
-draw(MatrixPanel_I2S_DMA* display, Timezone* local_tz)
+bool
+is_own_echo(const uint8_t* payload, size_t length) noexcept
+{
+    session_id_t id;
+    if (!peek_id(payload, length, &id))
+        return false;
+
+    // The loop owns `group`. A stale Lamport clock read from here only lets an
+    // echo through to the merge, which ignores it
+    if (!is_echo(group, id))
+        return false;
 
+    ++echoes_dropped;
+    return true;
+}
+
+template <typename G>
+void
+draw(Adafruit_GFX* gfx, Timezone* local_tz, time_t now, uint16_t color, bool snapshot)
 {
-    // Handle cold boot condition
-    if (mode == POMO_MODE_NONE)
-        reset_state();
+    // Mode in the GFX font, time in large digits below
+    constexpr int16_t BORDER = 1;
+    constexpr int16_t TIME_GAP = 2;
 
-    // Poll time for eztime
-    local_tz->tzTime();
+    constexpr seven_seg::style_t TIME_STYLE = seven_seg::fit(
+        "00:00", G::width - 2 * BORDER, G::height - GFX_CHAR_H - TIME_GAP - 2 * BORDER
+    );
+    constexpr int16_t BLOCK_H = GFX_CHAR_H + TIME_GAP + TIME_STYLE.height;
 
-    // Blink screen if needed
-    if (blinks_remaining != 0) {
-        display->clearScreen();
-        display->setBrightness8(255);
+    constexpr int16_t MODE_Y = G::centered_y(BLOCK_H);
+    constexpr int16_t TIME_Y = MODE_Y + GFX_CHAR_H + TIME_GAP;
 
-        if (blinks_remaining % 2 == 1)
-            display->fillScreenRGB888(0xff, 0xff, 0xff);
+    static_assert(MODE_Y >= 0, "Pomodoro face does not fit on the display");
 
-        --blinks_remaining;
-        return;
+    static seven_seg::renderer<6> time_digits(TIME_STYLE); // up to "255:00"
+
+#ifdef POMO_PROGRESS_BAR
+    static progress::bar<G> progress_indicator;
+#else
+    static progress::ring<G> progress_indicator;
+#endif
+
+    struct drawn_mode_t {
+        const char* text;
+        uint16_t color;
+    };
+    static drawn_mode_t drawn_mode[frame::BUFFER_COUNT]{};
+
+    // Handle cold boot condition
+    if (mode == POMO_MODE_NONE) {
+        if (snapshot)
+            return;
+
+        reset_state();
     }
 
-    // Called once per second
-    --time_remaining;
+    // Time left in this period, which shows in full while the last one's done
+    // pulse plays
+    uint32_t time_remaining = deadline > now ? min<time_t>(deadline - now, period_seconds) : 0;
 
     // Get time string
     int minutes = time_remaining / 60;
@@ -182,25 +381,164 @@ draw(MatrixPanel_I2S_DMA* display, Timezone* local_tz)
     time += ":";
     time += ezt::zeropad(seconds, 2);
 
-    // Show time
-    display->clearScreen();
+    // Show time, only touching what changed
+    if (frame::needs_full_redraw())
+        gfx->fillScreen(0);
 
-    print_centered(mode_string(), 6, display);
-    display->print("\n");
-    print_centered(time, display->getCursorY() + 5, display);
+    drawn_mode_t& drawn = drawn_mode[frame::back_buffer()];
+    const char* mode_text = mode_string();
+
+    if (frame::needs_full_redraw() || drawn.text != mode_text || drawn.color != color) {
+        gfx->fillRect(BORDER, MODE_Y, G::width - 2 * BORDER, GFX_CHAR_H, 0);
+        print_centered<G>(mode_text, MODE_Y, gfx);
+
+        drawn = {mode_text, color};
+    }
+
+    int16_t time_x = G::centered_x(seven_seg::text_width(TIME_STYLE, time.c_str()));
+    time_digits.draw(gfx, time_x, TIME_Y, time.c_str(), color);
+
+    progress_indicator.draw(
+        gfx, period_seconds - time_remaining, period_seconds, deadline, color
+    );
 
     // Update mode
-    if (time_remaining == 0) {
-        blinks_remaining = 5;
+    if (time_remaining == 0 && !snapshot) {
+        anim::start_pulse(PULSE_SECONDS * 1000);
+
+        // Log the period we just finished
+        time_t period_start = local_tz->tzTime(deadline - period_seconds, UTC_TIME);
+        history::append(history_kind(), period_start, period_seconds);
+
+        // The next period starts once the pulse is over. Count from the
+        // deadline rather than when we noticed, so every display in a group
+        // agrees, unless we slept through it.
+        time_t start = (now - deadline < PULSE_SECONDS ? deadline : now) + PULSE_SECONDS;
 
         if (mode == POMO_MODE_WORK) // Completed a pomodoro
-            on_work_completed();
+            on_work_completed(start);
         else // finished our break
-            on_break_completed();
+            on_break_completed(start);
+
+        // Publish info to MQTT, once we're done drawing
+        transition_pending = true;
+    }
+}
+
+template void draw<panel_geometry>(Adafruit_GFX*, Timezone*, time_t, uint16_t, bool);
+
+void
+poll() noexcept
+{
+    if (transition_pending) {
+        transition_pending = false;
 
-        // Publish info to MQTT
         publish_count();
+        publish_session();
+    }
+
+    portENTER_CRITICAL(&pending_mux);
+    pending_t next = pending;
+    pending = NO_PENDING;
+    portEXIT_CRITICAL(&pending_mux);
+
+    for (int8_t period = POMO_MODE_WORK; period <= POMO_MODE_LONG_BREAK; ++period) {
+        if (next.minutes[period] >= 0)
+            set_minutes(period, next.minutes[period]);
+    }
+
+    if (next.reset)
+        reset_state();
+
+    if (next.group >= 0)
+        set_group_mode(next.group);
+
+    if (next.has_session)
+        on_session(next.session);
+}
+
+void
+set_minutes(int8_t period, uint8_t minutes) noexcept
+{
+    switch (period) {
+        case POMO_MODE_WORK:
+            work_minutes = minutes;
+            log_i("Set work minutes to %u", work_minutes);
+            break;
+
+        case POMO_MODE_SHORT_BREAK:
+            short_break_minutes = minutes;
+            log_i("Set short break minutes to %u", short_break_minutes);
+            break;
+
+        case POMO_MODE_LONG_BREAK:
+            long_break_minutes = minutes;
+            log_i("Set long break minutes to %u", long_break_minutes);
+            break;
+
+        default:
+            log_e("Invalid pomodoro period %d", period);
+            break;
+    }
+}
+
+uint8_t
+minutes(int8_t period) noexcept
+{
+    switch (period) {
+        case POMO_MODE_WORK:
+            return work_minutes;
+        case POMO_MODE_SHORT_BREAK:
+            return short_break_minutes;
+        case POMO_MODE_LONG_BREAK:
+            return long_break_minutes;
+        default:
+            return 0;
     }
 }
 
+void
+reset() noexcept
+{
+    reset_state();
+}
+
+void
+begin() noexcept
+{
+    group.node_id = static_cast<uint32_t>(ESP.getEfuseMac() >> 16);
+}
+
+int8_t
+current_mode() noexcept
+{
+    return mode;
+}
+
+uint32_t
+completed() noexcept
+{
+    return num_pomodoros_completed;
+}
+
+void
+print_status() noexcept
+{
+    log_i(
+        "Pomodoro: node %08lx, group mode %s, session %lu from %08lx",
+        group.node_id,
+        group.enabled ? "on" : "off",
+        group.shown.version,
+        group.shown.origin
+    );
+
+    log_i(
+        "Adopted %lu sessions, dropped %lu echoes of ours, latency avg %lu ms, max %lld ms",
+        adopted_sessions,
+        echoes_dropped,
+        adopted_sessions ? static_cast<uint32_t>(total_latency_ms / adopted_sessions) : 0,
+        max_latency_ms
+    );
+}
+
 } // namespace pomodoro
@@ -0,0 +1,239 @@
+#include "settings.hpp"
+
+#include "modes.hpp"
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <esp_timer.h>
+
+using settings::record_t;
+
+namespace {
+
+constexpr const char* NVS_NAMESPACE = "display";
+constexpr const char* NVS_KEY = "settings";
+
+// Wait for a burst of changes to finish, then write at most this often
+constexpr int64_t SETTLE_US = 5 * 1000 * 1000;
+constexpr int64_t MIN_WRITE_INTERVAL_US = 60 * 1000 * 1000;
+
+constexpr int64_t DAY_US = 24LL * 60 * 60 * 1000 * 1000;
+
+// Set from the MQTT task, picked up between frames
+portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+record_t pending{};
+
+// Stats
+uint32_t received = 0;
+uint32_t rejected = 0;
+uint32_t merged = 0; // arrived before the previous one was applied
+uint32_t applied = 0;
+
+// Persistence
+Preferences prefs;
+bool prefs_open = false;
+
+record_t saved{};  // what NVS holds
+record_t latest{}; // what poll() saw last
+int64_t changed_us = 0;
+int64_t written_us = 0; // last write, even if it failed
+
+struct {
+    uint32_t writes;
+    uint32_t failures;
+    int64_t write_us_max;
+    int64_t restore_us;
+
+    // Writes per day, to keep an eye on flash wear
+    int64_t day_started_us;
+    uint32_t day_writes;
+    uint32_t last_day_writes;
+} nvs_stats{};
+
+/**
+ * Layer `next` over `base`, later fields win.
+ */
+void
+merge(record_t* base, const record_t& next)
+{
+    if (next.fields & settings::FIELD_MODE)
+        base->mode = next.mode;
+    if (next.fields & settings::FIELD_COLOR)
+        memcpy(base->color, next.color, sizeof(base->color));
+    if (next.fields & settings::FIELD_BRIGHTNESS)
+        base->brightness = next.brightness;
+    if (next.fields & settings::FIELD_WORK)
+        base->minutes[0] = next.minutes[0];
+    if (next.fields & settings::FIELD_SHORT_BREAK)
+        base->minutes[1] = next.minutes[1];
+    if (next.fields & settings::FIELD_LONG_BREAK)
+        base->minutes[2] = next.minutes[2];
+
+    base->fields |= next.fields;
+}
+
+void
+roll_day(int64_t now_us)
+{
+    if (now_us - nvs_stats.day_started_us < DAY_US)
+        return;
+
+    nvs_stats.last_day_writes = nvs_stats.day_writes;
+    nvs_stats.day_writes = 0;
+    nvs_stats.day_started_us = now_us;
+}
+
+void
+write(const record_t& record, int64_t now_us)
+{
+    uint8_t buf[settings::MAX_LEN];
+    size_t len = settings::encode(record, buf, sizeof(buf));
+
+    // Failed writes count too, so they're retried no more often than writes
+    written_us = now_us;
+
+    if (!len || prefs.putBytes(NVS_KEY, buf, len) != len) {
+        log_e("Error saving settings");
+        ++nvs_stats.failures;
+        return;
+    }
+
+    saved = record;
+
+    int64_t write_us = esp_timer_get_time() - now_us;
+
+    ++nvs_stats.writes;
+    ++nvs_stats.day_writes;
+    nvs_stats.write_us_max = max(nvs_stats.write_us_max, write_us);
+
+    log_i("Saved settings with fields %#x in %lld us", record.fields, write_us);
+}
+
+} // namespace
+
+namespace settings {
+
+void
+on_mqtt_message(const uint8_t* payload, size_t len) noexcept
+{
+    record_t record;
+
+    if (!decode(payload, len, modes::COUNT, &record)) {
+        log_e(
+            "Invalid config record, %u bytes, version %u",
+            len,
+            len > 0 ? payload[0] : 0
+        );
+
+        ++rejected;
+        return;
+    }
+
+    portENTER_CRITICAL(&mux);
+    if (pending.fields)
+        ++merged;
+
+    merge(&pending, record);
+    ++received;
+    portEXIT_CRITICAL(&mux);
+
+    log_i("Config record with fields %#x", record.fields);
+}
+
+bool
+take(record_t* record) noexcept
+{
+    portENTER_CRITICAL(&mux);
+    *record = pending;
+    pending = {};
+    portEXIT_CRITICAL(&mux);
+
+    if (!record->fields)
+        return false;
+
+    ++applied;
+    return true;
+}
+
+bool
+restore(record_t* record) noexcept
+{
+    int64_t started_us = esp_timer_get_time();
+
+    if (!prefs.begin(NVS_NAMESPACE)) {
+        log_e("Error opening NVS, settings won't be saved");
+        return false;
+    }
+
+    prefs_open = true;
+
+    uint8_t buf[MAX_LEN];
+    size_t len = prefs.getBytes(NVS_KEY, buf, sizeof(buf));
+
+    bool found = len && decode(buf, len, modes::COUNT, record);
+    if (found)
+        saved = latest = *record;
+
+    nvs_stats.restore_us = esp_timer_get_time() - started_us;
+    nvs_stats.day_started_us = started_us;
+
+    if (found)
+        log_i("Restored settings with fields %#x in %lld us", record->fields, nvs_stats.restore_us);
+    else if (len)
+        log_e("Ignoring invalid saved settings, %u bytes", len);
+    else
+        log_i("No saved settings");
+
+    return found;
+}
+
+void
+poll(const record_t& current) noexcept
+{
+    if (!prefs_open)
+        return;
+
+    int64_t now_us = esp_timer_get_time();
+    roll_day(now_us);
+
+    if (memcmp(&current, &latest, sizeof(current)) != 0) {
+        latest = current;
+        changed_us = now_us;
+    }
+
+    if (memcmp(&latest, &saved, sizeof(latest)) == 0)
+        return;
+
+    bool settled = now_us - changed_us >= SETTLE_US;
+    bool spaced = !written_us || now_us - written_us >= MIN_WRITE_INTERVAL_US;
+
+    if (settled && spaced)
+        write(latest, now_us);
+}
+
+void
+print_status() noexcept
+{
+    log_i(
+        "Config records: %lu received, %lu rejected, %lu merged, %lu applied",
+        received,
+        rejected,
+        merged,
+        applied
+    );
+
+    log_i(
+        "NVS: %lu writes, %lu failed, max %lld us, restore took %lld us",
+        nvs_stats.writes,
+        nvs_stats.failures,
+        nvs_stats.write_us_max,
+        nvs_stats.restore_us
+    );
+    log_i(
+        "NVS writes per day: %lu so far, %lu the day before",
+        nvs_stats.day_writes,
+        nvs_stats.last_day_writes
+    );
+}
+
+} // namespace settings
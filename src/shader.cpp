@@ -0,0 +1,348 @@
+#include "shader.hpp"
+
+using shader::kind_t;
+
+namespace {
+
+constexpr int16_t W = panel_geometry::width;
+constexpr int16_t H = panel_geometry::height;
+
+struct config_t {
+    kind_t kind;
+    uint32_t from, to; // gradient ends, RGB888
+};
+
+// Set from the MQTT task, picked up between frames
+portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+config_t pending{shader::SHADER_FLAT, 0, 0};
+bool pending_changed = false;
+
+config_t current{shader::SHADER_FLAT, 0, 0};
+
+// Scales every channel, all zeroes matches level 0
+uint8_t level_lut[256];
+uint8_t lut_level = 0;
+
+shader::painter h_painter(shader::SHADER_H_GRADIENT);
+shader::painter v_painter(shader::SHADER_V_GRADIENT);
+
+// Time of day
+constexpr uint16_t HUE_STEPS = 6 * 256; // six sectors of 256
+constexpr uint8_t NIGHT_LEVEL = 96;
+
+// Work, short break, long break
+constexpr uint32_t POMODORO_PALETTE[] = {0xff3010, 0x10ff40, 0x1060ff};
+
+void
+set_level(uint8_t level)
+{
+    if (level == lut_level)
+        return;
+
+    for (uint16_t i = 0; i < 256; ++i)
+        level_lut[i] = (i * level + 127) / 255;
+
+    lut_level = level;
+}
+
+uint8_t
+channel(uint32_t rgb, uint8_t shift)
+{
+    return (rgb >> shift) & 0xff;
+}
+
+/**
+ * a + (b - a) * t, with `t` in 0..256.
+ */
+uint8_t
+lerp(uint8_t a, uint8_t b, int16_t t)
+{
+    return a + (((b - a) * t) >> 8);
+}
+
+void
+build_gradient(uint32_t from, uint32_t to, uint16_t* lut, int16_t n)
+{
+    for (int16_t i = 0; i < n; ++i) {
+        int16_t t = n > 1 ? (i << 8) / (n - 1) : 0;
+
+        lut[i] = shader::rgb565(
+            lerp(channel(from, 16), channel(to, 16), t),
+            lerp(channel(from, 8), channel(to, 8), t),
+            lerp(channel(from, 0), channel(to, 0), t)
+        );
+    }
+}
+
+/**
+ * Fully saturated color of `hue`, in 0..HUE_STEPS.
+ */
+uint16_t
+hue565(uint16_t hue)
+{
+    uint8_t f = hue & 0xff;
+
+    switch (hue >> 8) {
+        case 0:
+            return shader::rgb565(255, f, 0);
+        case 1:
+            return shader::rgb565(255 - f, 255, 0);
+        case 2:
+            return shader::rgb565(0, 255, f);
+        case 3:
+            return shader::rgb565(0, 255 - f, 255);
+        case 4:
+            return shader::rgb565(f, 0, 255);
+        default:
+            return shader::rgb565(255, 0, 255 - f);
+    }
+}
+
+/**
+ * Full brightness from 7:00 to 21:00, NIGHT_LEVEL from 23:00 to 5:00, and
+ * linear in between.
+ */
+uint8_t
+level_at(uint16_t minute)
+{
+    constexpr uint16_t RAMP = 120;
+    constexpr uint16_t DAWN = 5 * 60;
+    constexpr uint16_t DUSK = 21 * 60;
+
+    constexpr uint8_t SPAN = 255 - NIGHT_LEVEL;
+
+    if (minute < DAWN || minute >= DUSK + RAMP)
+        return NIGHT_LEVEL;
+    if (minute < DAWN + RAMP)
+        return NIGHT_LEVEL + SPAN * (minute - DAWN) / RAMP;
+    if (minute >= DUSK)
+        return 255 - SPAN * (minute - DUSK) / RAMP;
+
+    return 255;
+}
+
+/**
+ * Clip [*a, *a + *len) to [0, limit).
+ */
+bool
+clip(int16_t* a, int16_t* len, int16_t limit)
+{
+    int16_t end = min(static_cast<int16_t>(*a + *len), limit);
+    *a = max(*a, static_cast<int16_t>(0));
+    *len = end - *a;
+
+    return *len > 0;
+}
+
+bool
+parse_color(const char* str, char** end, uint32_t* color)
+{
+    *color = strtoul(str, end, 16);
+    return *end != str && *color <= 0xffffff;
+}
+
+} // namespace
+
+namespace shader {
+
+uint16_t
+rgb565(uint8_t r, uint8_t g, uint8_t b) noexcept
+{
+    r = level_lut[r];
+    g = level_lut[g];
+    b = level_lut[b];
+
+    return ((r & 0xf8) << 8) | ((g & 0xfc) << 3) | (b >> 3);
+}
+
+void
+on_mqtt_message(const String& payload) noexcept
+{
+    config_t config{SHADER_FLAT, 0, 0};
+
+    if (payload == "flat") {
+        config.kind = SHADER_FLAT;
+    }
+    else if (payload == "hue") {
+        config.kind = SHADER_TIME_OF_DAY;
+    }
+    else if (payload == "pomodoro") {
+        config.kind = SHADER_POMODORO;
+    }
+    else if (payload.startsWith("hgrad ") || payload.startsWith("vgrad ")) {
+        config.kind = payload[0] == 'h' ? SHADER_H_GRADIENT : SHADER_V_GRADIENT;
+
+        char* end;
+        if (!parse_color(payload.c_str() + 6, &end, &config.from)
+            || !parse_color(end, &end, &config.to)) {
+            log_e("Invalid gradient \"%s\"", payload.c_str());
+            return;
+        }
+    }
+    else {
+        log_e("Invalid shader \"%s\"", payload.c_str());
+        return;
+    }
+
+    portENTER_CRITICAL(&mux);
+    pending = config;
+    pending_changed = true;
+    portEXIT_CRITICAL(&mux);
+
+    log_i("Shader set to \"%s\"", payload.c_str());
+}
+
+bool
+apply() noexcept
+{
+    bool first = lut_level == 0;
+
+    portENTER_CRITICAL(&mux);
+    bool changed = pending_changed;
+    config_t config = pending;
+    pending_changed = false;
+    portEXIT_CRITICAL(&mux);
+
+    if (!changed && !first)
+        return false;
+
+    current = config;
+    set_level(255);
+
+    if (current.kind == SHADER_H_GRADIENT)
+        h_painter.set_gradient(current.from, current.to);
+    else if (current.kind == SHADER_V_GRADIENT)
+        v_painter.set_gradient(current.from, current.to);
+
+    return changed;
+}
+
+uint16_t
+color(uint16_t flat_color, time_t local_time, int8_t pomodoro_mode) noexcept
+{
+    switch (current.kind) {
+        case SHADER_FLAT:
+            return flat_color;
+
+        case SHADER_TIME_OF_DAY:
+            {
+                uint16_t minute = (local_time % 86400) / 60;
+
+                set_level(level_at(minute));
+                return hue565(static_cast<uint32_t>(minute) * HUE_STEPS / (24 * 60));
+            }
+
+        case SHADER_POMODORO:
+            {
+                uint32_t rgb = POMODORO_PALETTE[pomodoro_mode > 0 ? pomodoro_mode : 0];
+
+                set_level(255);
+                return rgb565(channel(rgb, 16), channel(rgb, 8), channel(rgb, 0));
+            }
+
+        default:
+            return INK;
+    }
+}
+
+Adafruit_GFX*
+target(Adafruit_GFX* display) noexcept
+{
+    switch (current.kind) {
+        case SHADER_H_GRADIENT:
+            h_painter.set_target(display);
+            return &h_painter;
+
+        case SHADER_V_GRADIENT:
+            v_painter.set_target(display);
+            return &v_painter;
+
+        default:
+            return display;
+    }
+}
+
+/*****************************************************************************/
+
+painter::painter(kind_t kind) noexcept : Adafruit_GFX(W, H), kind_(kind)
+{
+    cp437(true); // like the display, see setup_led_matrix()
+}
+
+void
+painter::set_gradient(uint32_t from, uint32_t to) noexcept
+{
+    build_gradient(from, to, colors_, kind_ == SHADER_H_GRADIENT ? W : H);
+}
+
+void
+painter::drawPixel(int16_t x, int16_t y, uint16_t color)
+{
+    if (x < 0 || y < 0 || x >= W || y >= H)
+        return;
+
+    if (color)
+        color = kind_ == SHADER_H_GRADIENT ? colors_[x] : colors_[y];
+
+    target_->drawPixel(x, y, color);
+}
+
+void
+painter::drawFastHLine(int16_t x, int16_t y, int16_t w, uint16_t color)
+{
+    if (y < 0 || y >= H || !clip(&x, &w, W))
+        return;
+
+    if (!color || kind_ == SHADER_V_GRADIENT) {
+        target_->drawFastHLine(x, y, w, color ? colors_[y] : 0);
+        return;
+    }
+
+    for (int16_t i = x; i < x + w; ++i)
+        target_->drawPixel(i, y, colors_[i]);
+}
+
+void
+painter::drawFastVLine(int16_t x, int16_t y, int16_t h, uint16_t color)
+{
+    if (x < 0 || x >= W || !clip(&y, &h, H))
+        return;
+
+    if (!color || kind_ == SHADER_H_GRADIENT) {
+        target_->drawFastVLine(x, y, h, color ? colors_[x] : 0);
+        return;
+    }
+
+    for (int16_t i = y; i < y + h; ++i)
+        target_->drawPixel(x, i, colors_[i]);
+}
+
+void
+painter::fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color)
+{
+    if (!clip(&x, &w, W) || !clip(&y, &h, H))
+        return;
+
+    if (!color) {
+        target_->fillRect(x, y, w, h, 0);
+    }
+    else if (kind_ == SHADER_H_GRADIENT) {
+        for (int16_t i = x; i < x + w; ++i)
+            target_->drawFastVLine(i, y, h, colors_[i]);
+    }
+    else {
+        for (int16_t i = y; i < y + h; ++i)
+            target_->drawFastHLine(x, i, w, colors_[i]);
+    }
+}
+
+void
+painter::fillScreen(uint16_t color)
+{
+    if (!color)
+        target_->fillScreen(0);
+    else
+        fillRect(0, 0, W, H, color);
+}
+
+} // namespace shader
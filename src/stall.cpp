@@ -0,0 +1,345 @@
+#include "stall.hpp"
+
+#include "config.h"
+#include "connections.hpp"
+
+#include <esp_attr.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+
+#include <cstdarg>
+#include <cstring>
+
+// Older configs don't set one
+#ifndef LOOP_STALL_BUDGET_MS
+#define LOOP_STALL_BUDGET_MS 100
+#endif
+
+namespace {
+
+using stall::BUCKET_COUNT;
+using stall::BUCKET_MS;
+using stall::phase_t;
+
+constexpr uint8_t RING_LEN = 16;
+constexpr uint32_t RTC_MAGIC = 0x57a11000 | RING_LEN;
+
+constexpr unsigned long PUBLISH_INTERVAL_MS = 60 * 1000; // 1 minute
+
+struct stall_t {
+    uint32_t uptime_ms; // when the iteration ended
+    uint32_t total_ms;
+    uint32_t phase_ms; // spent in `phase`
+    phase_t phase;
+};
+
+/**
+ * What survives a reset.
+ */
+struct rtc_state_t {
+    uint32_t magic;
+    phase_t phase; // in progress, PHASE_LAST during setup()
+    uint8_t head;  // next slot in `ring`
+    uint8_t count;
+    stall_t ring[RING_LEN];
+};
+
+RTC_NOINIT_ATTR rtc_state_t rtc;
+
+rtc_state_t last_boot{};
+bool have_last_boot = false;
+esp_reset_reason_t last_reset = ESP_RST_UNKNOWN;
+
+uint32_t budget_us = LOOP_STALL_BUDGET_MS * 1000;
+
+// This iteration
+int64_t iteration_started_us = 0;
+int64_t phase_started_us = 0;
+phase_t current = stall::PHASE_CONNECT;
+uint32_t phase_us[stall::PHASE_LAST];
+
+// Since boot or the last reset_stats()
+stall::stats_t totals{};
+
+unsigned long published_ms = 0;
+
+uint8_t
+bucket(uint32_t total_us)
+{
+    uint8_t i = 0;
+    while (i < BUCKET_COUNT - 1 && total_us >= BUCKET_MS[i] * 1000)
+        ++i;
+
+    return i;
+}
+
+void
+finish_iteration(uint32_t total_us)
+{
+    // Only time spent working counts
+    total_us -= phase_us[stall::PHASE_IDLE];
+
+    ++totals.iterations;
+    totals.total_us += total_us;
+    ++totals.buckets[bucket(total_us)];
+    totals.max_us = max(totals.max_us, total_us);
+
+    if (total_us <= budget_us)
+        return;
+
+    // Blame whatever took the longest
+    uint8_t culprit = 0;
+    for (uint8_t i = 1; i < stall::PHASE_LAST; ++i) {
+        if (i != stall::PHASE_IDLE && phase_us[i] > phase_us[culprit])
+            culprit = i;
+    }
+
+    phase_t phase = static_cast<phase_t>(culprit);
+    ++totals.stalls[phase];
+
+    uint32_t uptime_ms = millis();
+    rtc.ring[rtc.head] = {uptime_ms, total_us / 1000, phase_us[phase] / 1000, phase};
+    rtc.head = (rtc.head + 1) % RING_LEN;
+    rtc.count = min<uint8_t>(rtc.count + 1, RING_LEN);
+
+    log_w(
+        "Loop stalled for %lu ms, %lu ms of it in %s",
+        total_us / 1000,
+        phase_us[phase] / 1000,
+        stall::phase_name(phase)
+    );
+}
+
+void
+print_ring(const rtc_state_t& state)
+{
+    for (uint8_t i = 0; i < state.count; ++i) {
+        const stall_t& s = state.ring[(state.head + RING_LEN - state.count + i) % RING_LEN];
+
+        log_i(
+            "  at %lu ms: %lu ms, %lu ms in %s",
+            s.uptime_ms,
+            s.total_ms,
+            s.phase_ms,
+            stall::phase_name(s.phase)
+        );
+    }
+}
+
+/**
+ * Append to `buf`, stopping at its end. Once something doesn't fit, `*len` stays
+ * at `size` and nothing more is appended.
+ */
+void
+append(char* buf, size_t size, size_t* len, const char* format, ...)
+{
+    if (*len >= size)
+        return;
+
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(buf + *len, size - *len, format, args);
+    va_end(args);
+
+    *len = written < 0 ? size : min(*len + written, size);
+}
+
+void
+publish()
+{
+    char stats_str[384];
+    size_t len = 0;
+
+    append(
+        stats_str,
+        sizeof(stats_str),
+        &len,
+        "{\"budget_ms\":%lu,\"iterations\":%lu,\"max_ms\":%lu,\"hist\":[",
+        budget_us / 1000,
+        totals.iterations,
+        totals.max_us / 1000
+    );
+
+    for (uint8_t i = 0; i < BUCKET_COUNT; ++i)
+        append(stats_str, sizeof(stats_str), &len, i ? ",%lu" : "%lu", totals.buckets[i]);
+
+    append(stats_str, sizeof(stats_str), &len, "],\"stalls\":{");
+
+    for (uint8_t i = 0; i < stall::PHASE_LAST; ++i) {
+        phase_t phase = static_cast<phase_t>(i);
+
+        append(
+            stats_str,
+            sizeof(stats_str),
+            &len,
+            i ? ",\"%s\":%lu" : "\"%s\":%lu",
+            stall::phase_name(phase),
+            totals.stalls[i]
+        );
+    }
+
+    append(stats_str, sizeof(stats_str), &len, "}}");
+
+    // Half a JSON object is no use to anyone
+    if (len >= sizeof(stats_str)) {
+        log_e("Stall stats don't fit in %u bytes", sizeof(stats_str));
+        return;
+    }
+
+    auto id = mqtt::publish("display/stats/stall", 0, false, stats_str, len);
+    if (!id)
+        log_w("Error publishing stall stats to MQTT");
+}
+
+} // namespace
+
+namespace stall {
+
+void
+begin() noexcept
+{
+    // Anything else is left over from power-on
+    bool valid = rtc.magic == RTC_MAGIC && rtc.phase <= PHASE_LAST && rtc.head < RING_LEN
+                 && rtc.count <= RING_LEN;
+
+    if (valid) {
+        last_boot = rtc;
+        have_last_boot = true;
+        last_reset = esp_reset_reason();
+
+        log_i(
+            "Last boot reset in %s (reason %d) after %u stalls",
+            phase_name(last_boot.phase),
+            last_reset,
+            last_boot.count
+        );
+    }
+
+    memset(&rtc, 0, sizeof(rtc));
+    rtc.magic = RTC_MAGIC;
+    rtc.phase = PHASE_LAST;
+}
+
+void
+loop_started() noexcept
+{
+    int64_t now_us = esp_timer_get_time();
+
+    // Whatever ran after the last phase, up to now, is part of it
+    if (iteration_started_us) {
+        phase_us[current] += now_us - phase_started_us;
+        finish_iteration(now_us - iteration_started_us);
+    }
+
+    memset(phase_us, 0, sizeof(phase_us));
+
+    iteration_started_us = now_us;
+    phase_started_us = now_us;
+    current = PHASE_CONNECT;
+    rtc.phase = PHASE_CONNECT;
+}
+
+void
+enter(phase_t phase) noexcept
+{
+    int64_t now_us = esp_timer_get_time();
+
+    phase_us[current] += now_us - phase_started_us;
+
+    phase_started_us = now_us;
+    current = phase;
+    rtc.phase = phase;
+}
+
+const char*
+phase_name(phase_t phase) noexcept
+{
+    switch (phase) {
+        case PHASE_CONNECT:
+            return "connect";
+        case PHASE_HOUSEKEEPING:
+            return "housekeeping";
+        case PHASE_CONSOLE:
+            return "console";
+        case PHASE_TIMEZONE:
+            return "timezone";
+        case PHASE_EZTIME:
+            return "eztime";
+        case PHASE_RENDER:
+            return "render";
+        case PHASE_FLIP:
+            return "flip";
+        case PHASE_IDLE:
+            return "idle";
+        default:
+            return "setup";
+    }
+}
+
+void
+set_budget(uint32_t budget_ms) noexcept
+{
+    budget_us = budget_ms * 1000;
+}
+
+void
+poll() noexcept
+{
+    if (millis() - published_ms < PUBLISH_INTERVAL_MS)
+        return;
+
+    published_ms = millis();
+    publish();
+}
+
+void
+print_status() noexcept
+{
+    log_i(
+        "Loop: %lu iterations, max %lu ms, budget %lu ms",
+        totals.iterations,
+        totals.max_us / 1000,
+        budget_us / 1000
+    );
+
+    for (uint8_t i = 0; i < BUCKET_COUNT; ++i) {
+        if (!totals.buckets[i])
+            continue;
+
+        if (i < BUCKET_COUNT - 1)
+            log_i("  < %lu ms: %lu", BUCKET_MS[i], totals.buckets[i]);
+        else
+            log_i("  >= %lu ms: %lu", BUCKET_MS[i - 1], totals.buckets[i]);
+    }
+
+    for (uint8_t i = 0; i < PHASE_LAST; ++i) {
+        if (totals.stalls[i])
+            log_i("Stalls in %s: %lu", phase_name(static_cast<phase_t>(i)), totals.stalls[i]);
+    }
+
+    log_i("Recent stalls:");
+    print_ring(rtc);
+
+    if (have_last_boot) {
+        log_i(
+            "Last boot reset in %s (reason %d), its stalls:",
+            phase_name(last_boot.phase),
+            last_reset
+        );
+        print_ring(last_boot);
+    }
+}
+
+stats_t
+stats() noexcept
+{
+    return totals;
+}
+
+void
+reset_stats() noexcept
+{
+    totals = {};
+}
+
+} // namespace stall
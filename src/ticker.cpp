@@ -0,0 +1,207 @@
+#include "ticker.hpp"
+
+#include "frame.hpp"
+#include "geometry.hpp"
+
+#include <Adafruit_GFX.h>
+#include <esp_timer.h>
+
+namespace {
+
+constexpr uint8_t QUEUE_LEN = 8;
+
+struct message_t {
+    char text[ticker::MAX_LEN + 1];
+};
+
+QueueHandle_t messages = nullptr;
+
+// Message on screen
+bool showing = false;
+uint16_t text_w = 0;   // in strip pixels
+int64_t started_us = 0; // when it started scrolling in
+
+// Stats, over the last full second
+struct window_t {
+    uint32_t frames;
+    uint32_t total_us;
+    uint32_t max_us;
+};
+
+window_t current{};
+window_t last_second{};
+int64_t window_started_us = 0;
+
+uint32_t dropped_messages = 0;
+
+void
+record_frame(int64_t draw_us)
+{
+    int64_t now_us = esp_timer_get_time();
+
+    if (now_us - window_started_us >= 1000000) {
+        last_second = current;
+        current = {};
+        window_started_us = now_us;
+    }
+
+    ++current.frames;
+    current.total_us += draw_us;
+    current.max_us = max(current.max_us, static_cast<uint32_t>(draw_us));
+}
+
+/**
+ * Copy columns of the strip starting at `strip_x` onto the display, lighting
+ * runs of set bits with a single line each.
+ */
+void
+blit(
+    Adafruit_GFX* gfx,
+    GFXcanvas1& strip,
+    int16_t strip_x,
+    int16_t x,
+    int16_t w,
+    int16_t y,
+    uint16_t color
+)
+{
+    const uint8_t* buf = strip.getBuffer();
+    const uint16_t stride = (strip.width() + 7) / 8;
+
+    for (int16_t row = 0; row < strip.height(); ++row) {
+        const uint8_t* line = buf + row * stride;
+        int16_t run_start = -1;
+
+        for (int16_t i = 0; i <= w; ++i) {
+            int16_t sx = strip_x + i;
+            bool lit = i < w && (line[sx >> 3] & (0x80 >> (sx & 7)));
+
+            if (lit && run_start < 0) {
+                run_start = i;
+            }
+            else if (!lit && run_start >= 0) {
+                gfx->drawFastHLine(x + run_start, y + row, i - run_start, color);
+                run_start = -1;
+            }
+        }
+    }
+}
+
+} // namespace
+
+namespace ticker {
+
+void
+begin() noexcept
+{
+    messages = xQueueCreate(QUEUE_LEN, sizeof(message_t));
+}
+
+void
+push(const uint8_t* text, size_t length) noexcept
+{
+    if (!messages)
+        return;
+
+    message_t message{};
+    memcpy(message.text, text, min(length, MAX_LEN));
+
+    if (xQueueSend(messages, &message, 0) != pdTRUE) {
+        ++dropped_messages;
+        log_w("Ticker queue full, dropping message");
+    }
+}
+
+bool
+is_active() noexcept
+{
+    return showing || (messages && uxQueueMessagesWaiting(messages) > 0);
+}
+
+template <typename G>
+void
+draw(Adafruit_GFX* gfx, int64_t at_us, uint16_t color, bool snapshot)
+{
+    // Double size text on panels tall enough for it
+    constexpr uint8_t TEXT_SIZE = G::height >= 4 * GFX_CHAR_H ? 2 : 1;
+    constexpr int16_t STRIP_W = MAX_LEN * GFX_CHAR_W * TEXT_SIZE;
+    constexpr int16_t STRIP_H = GFX_CHAR_H * TEXT_SIZE;
+    constexpr int16_t STRIP_Y = G::centered_y(STRIP_H);
+
+    constexpr int64_t SPEED = FPS * TEXT_SIZE; // pixels per second
+
+    static GFXcanvas1 strip(STRIP_W, STRIP_H);
+
+    int64_t draw_started_us = esp_timer_get_time();
+
+    if (frame::needs_full_redraw())
+        gfx->fillScreen(0);
+
+    // Rasterize the next message once, up front
+    message_t message;
+    if (!showing && !snapshot && messages && xQueueReceive(messages, &message, 0) == pdTRUE) {
+        strip.fillScreen(0);
+        strip.cp437(true);
+        strip.setTextWrap(false);
+        strip.setTextSize(TEXT_SIZE);
+        strip.setCursor(0, 0);
+        strip.print(message.text);
+
+        text_w = strlen(message.text) * GFX_CHAR_W * TEXT_SIZE;
+        started_us = at_us;
+        showing = true;
+    }
+
+    // The strip's rows are redrawn from scratch every frame
+    gfx->fillRect(0, STRIP_Y, G::width, STRIP_H, 0);
+
+    if (showing) {
+        // If the ticker was left mid-message, the message may be long gone by the
+        // time it comes back, so don't narrow until it's known to be on screen
+        int64_t scrolled = (at_us - started_us) * SPEED / 1000000;
+        int64_t left = static_cast<int64_t>(G::width) - scrolled;
+
+        if (left + text_w <= 0) {
+            if (!snapshot)
+                showing = false; // scrolled off, the next one starts next frame
+        }
+        else {
+            // Between -text_w and G::width here
+            int16_t strip_left = static_cast<int16_t>(min(left, static_cast<int64_t>(G::width)));
+            int16_t x = max(strip_left, static_cast<int16_t>(0));
+            int16_t w = min(strip_left + text_w, static_cast<int>(G::width)) - x;
+
+            blit(gfx, strip, x - strip_left, x, w, STRIP_Y, color);
+        }
+    }
+
+    if (!snapshot)
+        record_frame(esp_timer_get_time() - draw_started_us);
+}
+
+template void draw<panel_geometry>(Adafruit_GFX*, int64_t, uint16_t, bool);
+
+void
+print_status() noexcept
+{
+    window_t s = last_second;
+
+    log_i(
+        "Ticker: %lu fps, frame time avg %lu us, max %lu us, %u queued, %lu dropped",
+        s.frames,
+        s.frames ? s.total_us / s.frames : 0,
+        s.max_us,
+        messages ? uxQueueMessagesWaiting(messages) : 0,
+        dropped_messages
+    );
+}
+
+void
+reset_stats() noexcept
+{
+    current = {};
+    last_second = {};
+    dropped_messages = 0;
+}
+
+} // namespace ticker
@@ -0,0 +1,262 @@
+#include "time_sync.hpp"
+
+#include "idle.hpp"
+#include "timebase.hpp"
+
+#include <WiFi.h>
+#include <esp_timer.h>
+
+enum sync_kind_t : uint8_t {
+    SYNC_NTP,
+    SYNC_TIMEZONE,
+};
+
+namespace {
+
+constexpr uint32_t TASK_STACK_SIZE = 6 * 1024;
+constexpr UBaseType_t TASK_PRIORITY = 1;
+constexpr BaseType_t TASK_CORE = 0; // loop() runs on core 1
+
+constexpr uint8_t QUEUE_LEN = 4;
+constexpr TickType_t NTP_INTERVAL = pdMS_TO_TICKS(30 * 60 * 1000); // 30 minutes
+
+// Failed or offline requests are retried, backing off between these
+constexpr TickType_t RETRY_MIN = pdMS_TO_TICKS(2 * 1000);
+constexpr TickType_t RETRY_MAX = pdMS_TO_TICKS(60 * 1000);
+
+constexpr size_t LOCATION_LEN = 48;
+constexpr size_t POSIX_LEN = 64;
+
+const char* const NTP_SERVER = "pool.ntp.org";
+
+struct request_t {
+    sync_kind_t kind;
+    char location[LOCATION_LEN];
+};
+
+struct result_t {
+    sync_kind_t kind;
+    uint32_t duration_ms;
+
+    // SYNC_NTP
+    time_t time;
+    unsigned long measured_at; // millis() when `time` began
+
+    // SYNC_TIMEZONE
+    char posix[POSIX_LEN];
+};
+
+QueueHandle_t requests = nullptr;
+QueueHandle_t results = nullptr;
+
+// Stats, written by the task
+volatile uint32_t worst_ms = 0;
+volatile uint32_t ntp_syncs = 0;
+volatile uint32_t tz_lookups = 0;
+volatile uint32_t failures = 0;
+
+void
+finish(result_t& result, unsigned long started_ms)
+{
+    result.duration_ms = millis() - started_ms;
+    if (result.duration_ms > worst_ms)
+        worst_ms = result.duration_ms;
+
+    xQueueSend(results, &result, portMAX_DELAY);
+    idle::wake();
+}
+
+bool
+sync_ntp()
+{
+    result_t result{};
+    result.kind = SYNC_NTP;
+
+    unsigned long started_ms = millis();
+
+    if (!ezt::queryNTP(NTP_SERVER, result.time, result.measured_at)) {
+        log_w("NTP query failed");
+        ++failures;
+        return false;
+    }
+
+    ++ntp_syncs;
+    finish(result, started_ms);
+    return true;
+}
+
+bool
+lookup_timezone(const char* location)
+{
+    result_t result{};
+    result.kind = SYNC_TIMEZONE;
+
+    unsigned long started_ms = millis();
+
+    Timezone tz;
+    if (!tz.setLocation(location)) {
+        log_w("Timezone lookup for %s failed", location);
+        ++failures;
+        return false;
+    }
+
+    strncpy(result.posix, tz.getPosix().c_str(), POSIX_LEN - 1);
+
+    ++tz_lookups;
+    finish(result, started_ms);
+    return true;
+}
+
+void
+task(void* arg)
+{
+    (void)arg;
+
+    // Requests are kept until they succeed, a lost packet at boot would
+    // otherwise leave the clock unset until the next periodic sync
+    bool ntp_pending = false;
+    char tz_pending[LOCATION_LEN] = ""; // location still to look up
+    TickType_t retry = 0; // after the last failure, 0 if it didn't fail
+
+    for (;;) {
+        bool pending = ntp_pending || tz_pending[0];
+
+        // Offline with work to do, check on WiFi every RETRY_MIN
+        TickType_t wait = pending ? max(retry, RETRY_MIN) : NTP_INTERVAL;
+
+        request_t request;
+        if (xQueueReceive(requests, &request, wait) == pdTRUE) {
+            if (request.kind == SYNC_NTP)
+                ntp_pending = true;
+            else
+                strncpy(tz_pending, request.location, LOCATION_LEN - 1);
+        }
+        else if (!pending) {
+            // Resync NTP every so often even if nobody asks
+            ntp_pending = true;
+        }
+
+        // Try again once we're back online
+        if (!WiFi.isConnected())
+            continue;
+
+        if (ntp_pending)
+            ntp_pending = !sync_ntp();
+
+        if (tz_pending[0] && lookup_timezone(tz_pending))
+            tz_pending[0] = '\0';
+
+        if (ntp_pending || tz_pending[0]) {
+            retry = retry ? min(retry * 2, RETRY_MAX) : RETRY_MIN;
+            log_w("Retrying time sync in %lu ms", retry * portTICK_PERIOD_MS);
+        }
+        else {
+            retry = 0;
+        }
+    }
+}
+
+void
+send_request(const request_t& request)
+{
+    if (!requests || xQueueSend(requests, &request, 0) != pdTRUE)
+        log_w("Time sync request dropped");
+}
+
+} // namespace
+
+namespace time_sync {
+
+void
+begin() noexcept
+{
+    // We do NTP ourselves, stop ezTime from blocking on it in events()
+    ezt::setInterval(0);
+
+    requests = xQueueCreate(QUEUE_LEN, sizeof(request_t));
+    results = xQueueCreate(QUEUE_LEN, sizeof(result_t));
+
+    xTaskCreatePinnedToCore(
+        task, "time_sync", TASK_STACK_SIZE, nullptr, TASK_PRIORITY, nullptr, TASK_CORE
+    );
+}
+
+void
+request_ntp() noexcept
+{
+    request_t request{};
+    request.kind = SYNC_NTP;
+
+    send_request(request);
+}
+
+void
+request_timezone(const char* location) noexcept
+{
+    request_t request{};
+    request.kind = SYNC_TIMEZONE;
+    strncpy(request.location, location, LOCATION_LEN - 1);
+
+    send_request(request);
+}
+
+void
+apply(Timezone* tz) noexcept
+{
+    result_t result;
+
+    while (results && xQueueReceive(results, &result, 0) == pdTRUE) {
+        switch (result.kind) {
+            case SYNC_NTP:
+                {
+                    unsigned long elapsed_ms = millis() - result.measured_at;
+                    int64_t measured_us = esp_timer_get_time() - elapsed_ms * 1000LL;
+
+                    timebase::on_sample(result.time, measured_us);
+                    timebase::publish();
+
+                    // Keep ezTime roughly in line for anything still asking it
+                    int64_t now_ms = timebase::now_ms();
+                    ezt::setTime(now_ms / 1000, now_ms % 1000);
+
+                    log_i("NTP synced in %lu ms", result.duration_ms);
+                    break;
+                }
+
+            case SYNC_TIMEZONE:
+                tz->setPosix(result.posix);
+                log_i("Timezone set to %s in %lu ms", result.posix, result.duration_ms);
+                break;
+        }
+    }
+}
+
+uint32_t
+worst_stall_ms() noexcept
+{
+    return worst_ms;
+}
+
+void
+print_status() noexcept
+{
+    log_i(
+        "Time sync: %lu NTP syncs, %lu timezone lookups, %lu failures, "
+        "worst stall avoided %lu ms",
+        ntp_syncs,
+        tz_lookups,
+        failures,
+        worst_ms
+    );
+}
+
+void
+reset_stats() noexcept
+{
+    worst_ms = 0;
+    ntp_syncs = 0;
+    tz_lookups = 0;
+    failures = 0;
+}
+
+} // namespace time_sync
@@ -0,0 +1,118 @@
+#include "timebase.hpp"
+
+#include "connections.hpp"
+#include "timebase_model.hpp"
+
+#include <esp_timer.h>
+
+namespace {
+
+portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+
+timebase::discipline_t discipline{};
+
+} // namespace
+
+namespace timebase {
+
+void
+on_sample(time_t time, int64_t mono_us) noexcept
+{
+    portENTER_CRITICAL(&mux);
+    apply_sample(&discipline, time, mono_us);
+    portEXIT_CRITICAL(&mux);
+}
+
+bool
+is_set() noexcept
+{
+    return discipline.is_set;
+}
+
+int64_t
+wall_us(int64_t mono_us) noexcept
+{
+    portENTER_CRITICAL(&mux);
+    int64_t wall = wall_at(discipline.model, mono_us);
+    portEXIT_CRITICAL(&mux);
+
+    return wall;
+}
+
+int64_t
+now_ms() noexcept
+{
+    return wall_us(esp_timer_get_time()) / 1000;
+}
+
+time_t
+now() noexcept
+{
+    return wall_us(esp_timer_get_time()) / 1000000;
+}
+
+metrics_t
+metrics() noexcept
+{
+    int64_t mono_us = esp_timer_get_time();
+
+    portENTER_CRITICAL(&mux);
+
+    const discipline_t& d = discipline;
+
+    metrics_t m;
+    m.is_set = d.is_set;
+    m.slewing = d.model.slew_end_us > mono_us;
+    m.offset_ms = static_cast<int32_t>(d.last_offset_us / 1000);
+    m.slew_left_ms = static_cast<int32_t>(slew_left_at(d.model, mono_us) / 1000);
+    m.drift_ppb = static_cast<int32_t>(d.model.drift_ppb);
+    m.samples = d.samples;
+    m.steps = d.steps;
+
+    portEXIT_CRITICAL(&mux);
+
+    return m;
+}
+
+void
+print_status() noexcept
+{
+    metrics_t m = metrics();
+
+    log_i(
+        "Timebase: %s, last offset %ld ms, %s%ld ms left, drift %ld ppb, %lu samples, "
+        "%lu steps",
+        m.is_set ? "set" : "not set",
+        m.offset_ms,
+        m.slewing ? "slewing, " : "",
+        m.slew_left_ms,
+        m.drift_ppb,
+        m.samples,
+        m.steps
+    );
+}
+
+void
+publish() noexcept
+{
+    metrics_t m = metrics();
+
+    char stats_str[128];
+    int len = snprintf(
+        stats_str,
+        sizeof(stats_str),
+        "{\"offset_ms\":%ld,\"slew_left_ms\":%ld,\"drift_ppb\":%ld,\"samples\":%lu,"
+        "\"steps\":%lu}",
+        static_cast<long>(m.offset_ms),
+        static_cast<long>(m.slew_left_ms),
+        static_cast<long>(m.drift_ppb),
+        static_cast<unsigned long>(m.samples),
+        static_cast<unsigned long>(m.steps)
+    );
+
+    auto id = mqtt::publish("display/stats/time", 0, false, stats_str, len);
+    if (!id)
+        log_w("Error publishing time stats to MQTT");
+}
+
+} // namespace timebase
@@ -1,9 +1,5 @@
 #include "utils.hpp"
 
-#include "config.h"
-
-#include <ESP32-HUB75-MatrixPanel-I2S-DMA.h>
-
 const char*
 get_reset_reason(int core) noexcept
 {
@@ -94,24 +90,57 @@ print_chip_debug_info() noexcept
         log_d("Core 1 reset reason: %s", get_reset_reason(1));
 }
 
+/*****************************************************************************/
+
+namespace text_layout {
+
+static cache_t cache{};
+static uint16_t current_style = 1; // default font, size 1
+
 void
-print_centered(const char* text, uint16_t cursor_y, MatrixPanel_I2S_DMA* display)
+set_style(Adafruit_GFX* gfx, const GFXfont* font, uint8_t size) noexcept
 {
+    gfx->setFont(font);
+    gfx->setTextSize(size);
+
+    // Fonts are few and statically allocated, so the low bits of the pointer are
+    // enough to tell them apart
+    uint16_t font_bits = static_cast<uint16_t>(reinterpret_cast<uintptr_t>(font) >> 2);
+    current_style = static_cast<uint16_t>(font_bits << 4) ^ size;
+}
+
+const entry_t&
+measure(const char* text, uint16_t area_width, Adafruit_GFX* gfx) noexcept
+{
+    uint16_t length;
+    uint32_t text_hash = hash(text, &length);
+
+    const entry_t* cached = lookup(&cache, text_hash, length, current_style, area_width);
+    if (cached)
+        return *cached;
+
     // Find text size
     int16_t x, y;
     uint16_t w, h;
 
-    display->getTextBounds(text, 0, 0, &x, &y, &w, &h);
+    gfx->getTextBounds(text, 0, 0, &x, &y, &w, &h);
 
     log_d("Text starts at (%d, %d) with width %u and height %u", x, y, w, h);
-
-    // Get cursor position
     assert(x == 0 && y == 0);
 
-    uint16_t cursor_x = (MAT_RES_X - w) / 2;
-    log_d("Drawing at (%u, %u)", cursor_x, cursor_y);
+    return insert(&cache, text_hash, length, current_style, area_width, w, h);
+}
 
-    // Print text
-    display->setCursor(cursor_x, cursor_y);
-    display->print(text);
+stats_t
+stats() noexcept
+{
+    return cache.counters;
 }
+
+void
+reset_stats() noexcept
+{
+    cache.counters = {};
+}
+
+} // namespace text_layout
@@ -0,0 +1,296 @@
+#include "history_log.hpp"
+
+#include <unity.h>
+
+#include <algorithm>
+#include <vector>
+
+using namespace history;
+
+namespace {
+
+/**
+ * Files in memory. Writes can be made to stop short after some bytes, like a
+ * full filesystem or a power cut.
+ */
+class memory_store : public file_store_t {
+public:
+    size_t
+    read(uint8_t index, size_t offset, void* buf, size_t len) override
+    {
+        const std::vector<uint8_t>& file = files[index];
+        if (offset >= file.size())
+            return 0;
+
+        len = std::min(len, file.size() - offset);
+        memcpy(buf, file.data() + offset, len);
+        return len;
+    }
+
+    size_t
+    write(uint8_t index, bool truncate, const void* data, size_t len) override
+    {
+        std::vector<uint8_t>& file = files[index];
+        if (truncate)
+            file.clear();
+
+        len = std::min(len, write_limit);
+        write_limit -= len;
+
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        file.insert(file.end(), bytes, bytes + len);
+
+        ++writes;
+        return len;
+    }
+
+    size_t
+    records(uint8_t index) const
+    {
+        return files[index].size() / sizeof(record_t);
+    }
+
+    std::vector<uint8_t> files[NUM_FILES];
+    size_t write_limit = SIZE_MAX;
+    int writes = 0;
+};
+
+memory_store store;
+log_t log_state;
+
+uint32_t now_ms;
+
+void
+append_records(uint32_t count)
+{
+    for (uint32_t i = 0; i < count; ++i)
+        append(&log_state, KIND_WORK, 1000 + i, 25 * 60, now_ms);
+}
+
+/**
+ * Append and flush whenever it's due, like poll() does.
+ */
+void
+log_records(uint32_t count)
+{
+    for (uint32_t i = 0; i < count; ++i) {
+        append_records(1);
+        if (flush_due(&log_state, now_ms))
+            flush(&log_state, now_ms);
+    }
+}
+
+/**
+ * A fresh log over what's in the store, like after a reboot.
+ *
+ * @returns the number of records read back, each of which must be there once.
+ */
+uint32_t
+reboot()
+{
+    log_state = log_t{};
+    log_state.files = &store;
+
+    std::vector<bool> seen(NUM_FILES * RECORDS_PER_FILE * 2);
+    uint32_t records = 0;
+
+    recover(&log_state, [&](const record_t& record) {
+        TEST_ASSERT_FALSE(seen.at(record.seq));
+        seen.at(record.seq) = true;
+        ++records;
+    });
+
+    return records;
+}
+
+} // namespace
+
+void
+setUp()
+{
+    store = memory_store{};
+    log_state = log_t{};
+    log_state.files = &store;
+    now_ms = 1000;
+}
+
+void
+tearDown()
+{}
+
+void
+test_batches_of_eight()
+{
+    log_records(BATCH_LEN - 1);
+    TEST_ASSERT_EQUAL(0, store.writes);
+    TEST_ASSERT_EQUAL(BATCH_LEN - 1, log_state.batch_len);
+
+    // The eighth fills the batch, and it all goes out in one write
+    log_records(1);
+    TEST_ASSERT_EQUAL(1, store.writes);
+    TEST_ASSERT_EQUAL(0, log_state.batch_len);
+    TEST_ASSERT_EQUAL_size_t(BATCH_LEN, store.records(0));
+
+    log_records(3 * BATCH_LEN);
+    TEST_ASSERT_EQUAL(4, store.writes);
+    TEST_ASSERT_EQUAL_UINT32(4, log_state.stats.flushes);
+}
+
+void
+test_flushes_old_batch()
+{
+    log_records(1);
+    now_ms += FLUSH_INTERVAL_MS - 1;
+    TEST_ASSERT_FALSE(flush_due(&log_state, now_ms));
+
+    // Records added since don't push it back
+    log_records(2);
+    TEST_ASSERT_EQUAL(0, store.writes);
+
+    now_ms += 1;
+    TEST_ASSERT_TRUE(flush_due(&log_state, now_ms));
+    flush(&log_state, now_ms);
+    TEST_ASSERT_EQUAL_size_t(3, store.records(0));
+
+    // The clock starts over with the next record
+    now_ms += FLUSH_INTERVAL_MS;
+    TEST_ASSERT_FALSE(flush_due(&log_state, now_ms));
+    log_records(1);
+    now_ms += FLUSH_INTERVAL_MS - 1;
+    TEST_ASSERT_FALSE(flush_due(&log_state, now_ms));
+}
+
+void
+test_full_batch_drops()
+{
+    append_records(BATCH_LEN + 2);
+
+    TEST_ASSERT_EQUAL(BATCH_LEN, log_state.batch_len);
+    TEST_ASSERT_EQUAL_UINT32(BATCH_LEN, log_state.stats.appends);
+    TEST_ASSERT_EQUAL_UINT32(2, log_state.stats.dropped);
+
+    // Dropped records don't use up sequence numbers
+    TEST_ASSERT_EQUAL_UINT32(BATCH_LEN, log_state.next_seq);
+}
+
+void
+test_ring_wraps()
+{
+    // Fill every file, then one batch more
+    log_records(NUM_FILES * RECORDS_PER_FILE + BATCH_LEN);
+
+    TEST_ASSERT_EQUAL_UINT32(NUM_FILES, log_state.stats.rotations);
+    TEST_ASSERT_EQUAL(0, log_state.current_file);
+
+    // The oldest file was started over, the rest are full
+    TEST_ASSERT_EQUAL_size_t(BATCH_LEN, store.records(0));
+    for (uint8_t index = 1; index < NUM_FILES; ++index)
+        TEST_ASSERT_EQUAL_size_t(RECORDS_PER_FILE, store.records(index));
+
+    record_t first;
+    store.read(0, 0, &first, sizeof(first));
+    TEST_ASSERT_EQUAL_UINT32(NUM_FILES * RECORDS_PER_FILE, first.seq);
+}
+
+void
+test_recovers_end_of_log()
+{
+    log_records(RECORDS_PER_FILE + 3 * BATCH_LEN);
+    uint32_t next_seq = log_state.next_seq;
+
+    TEST_ASSERT_EQUAL_UINT32(RECORDS_PER_FILE + 3 * BATCH_LEN, reboot());
+    TEST_ASSERT_EQUAL(1, log_state.current_file);
+    TEST_ASSERT_EQUAL(3 * BATCH_LEN, log_state.records_in_file);
+    TEST_ASSERT_EQUAL_UINT32(next_seq, log_state.next_seq);
+
+    // Appends carry on where the log left off
+    log_records(BATCH_LEN);
+    TEST_ASSERT_EQUAL_size_t(4 * BATCH_LEN, store.records(1));
+}
+
+void
+test_recovers_after_wrap()
+{
+    log_records(NUM_FILES * RECORDS_PER_FILE + 2 * BATCH_LEN);
+    uint32_t next_seq = log_state.next_seq;
+
+    reboot();
+    TEST_ASSERT_EQUAL(0, log_state.current_file);
+    TEST_ASSERT_EQUAL(2 * BATCH_LEN, log_state.records_in_file);
+    TEST_ASSERT_EQUAL_UINT32(next_seq, log_state.next_seq);
+}
+
+void
+test_recovers_torn_segment()
+{
+    log_records(2 * BATCH_LEN);
+
+    // Power is cut five bytes into the next batch
+    log_records(BATCH_LEN - 1);
+    store.write_limit = 5;
+    log_records(1);
+    TEST_ASSERT_EQUAL_size_t(2 * BATCH_LEN * sizeof(record_t) + 5, store.files[0].size());
+
+    // Only whole records are read back, and the torn file isn't appended to
+    TEST_ASSERT_EQUAL_UINT32(2 * BATCH_LEN, reboot());
+    TEST_ASSERT_EQUAL_UINT32(2 * BATCH_LEN, log_state.next_seq);
+
+    store.write_limit = SIZE_MAX;
+    log_records(BATCH_LEN);
+
+    TEST_ASSERT_EQUAL_size_t(2 * BATCH_LEN * sizeof(record_t) + 5, store.files[0].size());
+    TEST_ASSERT_EQUAL_size_t(BATCH_LEN, store.records(1));
+
+    // Everything lines up after another reboot
+    TEST_ASSERT_EQUAL_UINT32(3 * BATCH_LEN, reboot());
+    TEST_ASSERT_EQUAL(1, log_state.current_file);
+    TEST_ASSERT_EQUAL_UINT32(3 * BATCH_LEN, log_state.next_seq);
+}
+
+void
+test_short_write_keeps_the_rest()
+{
+    log_records(BATCH_LEN - 1);
+
+    // Three whole records and part of a fourth make it
+    store.write_limit = 3 * sizeof(record_t) + 5;
+    log_records(1);
+
+    TEST_ASSERT_TRUE(log_state.flush_failed);
+    TEST_ASSERT_EQUAL(BATCH_LEN - 3, log_state.batch_len);
+    TEST_ASSERT_EQUAL_UINT32(3, log_state.batch[0].seq);
+
+    // No retry until the interval is up
+    store.write_limit = SIZE_MAX;
+    now_ms += RETRY_INTERVAL_MS - 1;
+    TEST_ASSERT_FALSE(flush_due(&log_state, now_ms));
+    now_ms += 1;
+    TEST_ASSERT_TRUE(flush_due(&log_state, now_ms));
+    flush(&log_state, now_ms);
+
+    // The rest went to a fresh file rather than after the scrap
+    TEST_ASSERT_FALSE(log_state.flush_failed);
+    TEST_ASSERT_EQUAL_size_t(3, store.records(0));
+    TEST_ASSERT_EQUAL_size_t(BATCH_LEN - 3, store.records(1));
+
+    // Every record is there once
+    TEST_ASSERT_EQUAL_UINT32(BATCH_LEN, reboot());
+    TEST_ASSERT_EQUAL_UINT32(BATCH_LEN, log_state.next_seq);
+}
+
+int
+main()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_batches_of_eight);
+    RUN_TEST(test_flushes_old_batch);
+    RUN_TEST(test_full_batch_drops);
+    RUN_TEST(test_ring_wraps);
+    RUN_TEST(test_recovers_end_of_log);
+    RUN_TEST(test_recovers_after_wrap);
+    RUN_TEST(test_recovers_torn_segment);
+    RUN_TEST(test_short_write_keeps_the_rest);
+
+    return UNITY_END();
+}
@@ -0,0 +1,135 @@
+#include "idle.hpp"
+
+#include <unity.h>
+
+#include <algorithm>
+
+using namespace idle;
+
+namespace {
+
+constexpr int64_t NOW_US = 5 * 1000 * 1000;
+
+} // namespace
+
+void
+setUp()
+{}
+
+void
+tearDown()
+{}
+
+void
+test_wait_past_deadline()
+{
+    TEST_ASSERT_EQUAL_UINT32(0, wait_ms(NOW_US, 0));
+    TEST_ASSERT_EQUAL_UINT32(0, wait_ms(NOW_US, NOW_US - 1));
+    TEST_ASSERT_EQUAL_UINT32(0, wait_ms(NOW_US, NOW_US));
+}
+
+void
+test_wait_rounds_up()
+{
+    // Waking a hair late beats waking early and spinning
+    TEST_ASSERT_EQUAL_UINT32(1, wait_ms(NOW_US, NOW_US + 1));
+    TEST_ASSERT_EQUAL_UINT32(1, wait_ms(NOW_US, NOW_US + 1000));
+    TEST_ASSERT_EQUAL_UINT32(2, wait_ms(NOW_US, NOW_US + 1001));
+    TEST_ASSERT_EQUAL_UINT32(20, wait_ms(NOW_US, NOW_US + 20 * 1000));
+}
+
+void
+test_wait_is_capped()
+{
+    TEST_ASSERT_EQUAL_UINT32(MAX_WAIT_MS, wait_ms(NOW_US, NOW_US + MAX_WAIT_MS * 1000 - 1));
+    TEST_ASSERT_EQUAL_UINT32(MAX_WAIT_MS, wait_ms(NOW_US, NOW_US + MAX_WAIT_MS * 1000));
+    TEST_ASSERT_EQUAL_UINT32(MAX_WAIT_MS, wait_ms(NOW_US, NOW_US + 60 * 1000 * 1000));
+    TEST_ASSERT_EQUAL_UINT32(MAX_WAIT_MS, wait_ms(NOW_US, NO_DEADLINE));
+}
+
+void
+test_due_frame_is_next()
+{
+    // Without a back buffer the frame waits for its time, whatever else
+    TEST_ASSERT_EQUAL_INT64(NOW_US, next_work_us(false, 50, false, NOW_US));
+    TEST_ASSERT_EQUAL_INT64(NOW_US, next_work_us(false, 0, true, NOW_US));
+    TEST_ASSERT_EQUAL_INT64(NOW_US, next_work_us(false, 1, true, NOW_US));
+}
+
+void
+test_pending_flip_waits()
+{
+    // The flip wakes the loop, spinning until then would only burn the CPU
+    TEST_ASSERT_EQUAL_INT64(NO_DEADLINE, next_work_us(true, 50, false, 0));
+    TEST_ASSERT_EQUAL_INT64(NO_DEADLINE, next_work_us(true, 1, false, 0));
+    TEST_ASSERT_EQUAL_INT64(NO_DEADLINE, next_work_us(true, 0, true, 0));
+}
+
+void
+test_frames_wanted_go_again()
+{
+    TEST_ASSERT_EQUAL_INT64(0, next_work_us(false, 50, false, 0));
+    TEST_ASSERT_EQUAL_INT64(0, next_work_us(false, 1, false, 0));
+    TEST_ASSERT_EQUAL_INT64(0, next_work_us(false, 0, true, 0));
+}
+
+void
+test_static_screen_sleeps()
+{
+    TEST_ASSERT_EQUAL_INT64(NO_DEADLINE, next_work_us(false, 0, false, 0));
+
+    // Which still wakes for polled housekeeping
+    TEST_ASSERT_EQUAL_UINT32(MAX_WAIT_MS, wait_ms(NOW_US, next_work_us(false, 0, false, 0)));
+}
+
+/**
+ * Drive the loop's wait at 1 fps with a fake clock: every frame should cost one
+ * wait for the flip before it, and no spinning.
+ */
+void
+test_one_fps_wakeups()
+{
+    int64_t now_us = NOW_US;
+    int64_t flip_at_us = NOW_US + 1000 * 1000;
+
+    uint32_t frames = 0;
+    uint32_t waits = 0;
+
+    while (frames < 10) {
+        bool flip_pending = now_us < flip_at_us;
+        int64_t deadline_us = next_work_us(flip_pending, 1, false, 0);
+
+        if (deadline_us == NO_DEADLINE) {
+            // Woken by the flip, the wait cap is longer than a frame
+            int64_t woken_us = now_us + wait_ms(now_us, deadline_us) * int64_t{1000};
+            now_us = std::min(flip_at_us, woken_us);
+            ++waits;
+        }
+        else {
+            // Drew the next frame, it flips a second later
+            TEST_ASSERT_EQUAL_INT64(0, deadline_us);
+            flip_at_us += 1000 * 1000;
+            ++frames;
+        }
+    }
+
+    TEST_ASSERT_EQUAL_UINT32(10, waits);
+    TEST_ASSERT_EQUAL_INT64(NOW_US + 10 * 1000 * 1000, now_us);
+}
+
+int
+main()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_wait_past_deadline);
+    RUN_TEST(test_wait_rounds_up);
+    RUN_TEST(test_wait_is_capped);
+    RUN_TEST(test_due_frame_is_next);
+    RUN_TEST(test_pending_flip_waits);
+    RUN_TEST(test_frames_wanted_go_again);
+    RUN_TEST(test_static_screen_sleeps);
+    RUN_TEST(test_one_fps_wakeups);
+
+    return UNITY_END();
+}
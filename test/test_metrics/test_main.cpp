@@ -0,0 +1,127 @@
+#include "metrics_response.hpp"
+
+#include <unity.h>
+
+#include <cstring>
+
+using namespace metrics;
+
+namespace {
+
+response_t response;
+
+} // namespace
+
+void
+setUp()
+{
+    clear(&response);
+}
+
+void
+tearDown()
+{}
+
+void
+test_counters_and_gauges()
+{
+    counter(&response, "a_total", "As.", 42);
+    counter_us(&response, "b_seconds_total", "Bs.", 3000250);
+    gauge(&response, "c", "C.", 0.5);
+
+    TEST_ASSERT_EQUAL_STRING(
+        "# HELP a_total As.\n# TYPE a_total counter\na_total 42\n"
+        "# HELP b_seconds_total Bs.\n# TYPE b_seconds_total counter\n"
+        "b_seconds_total 3.000250\n"
+        "# HELP c C.\n# TYPE c gauge\nc 0.5\n",
+        response.text
+    );
+    TEST_ASSERT_EQUAL_size_t(strlen(response.text), response.len);
+    TEST_ASSERT_FALSE(response.overflowed);
+}
+
+void
+test_histogram_is_cumulative()
+{
+    const uint32_t bounds_ms[] = {1, 10};
+    const uint32_t counts[] = {5, 3, 2};
+
+    histogram_ms(&response, "d_seconds", "Ds.", bounds_ms, 2, counts, 1500000);
+
+    TEST_ASSERT_EQUAL_STRING(
+        "# HELP d_seconds Ds.\n# TYPE d_seconds histogram\n"
+        "d_seconds_bucket{le=\"0.001\"} 5\n"
+        "d_seconds_bucket{le=\"0.01\"} 8\n"
+        "d_seconds_bucket{le=\"+Inf\"} 10\n"
+        "d_seconds_sum 1.500000\n"
+        "d_seconds_count 10\n",
+        response.text
+    );
+}
+
+void
+test_fills_to_the_last_byte()
+{
+    // One byte is kept for the terminator
+    static char text[RESPONSE_LEN];
+    memset(text, 'x', RESPONSE_LEN - 1);
+    text[RESPONSE_LEN - 1] = '\0';
+
+    append(&response, "%s", text);
+    TEST_ASSERT_FALSE(response.overflowed);
+    TEST_ASSERT_EQUAL_size_t(RESPONSE_LEN - 1, response.len);
+
+    append(&response, "");
+    TEST_ASSERT_FALSE(response.overflowed);
+
+    append(&response, "y");
+    TEST_ASSERT_TRUE(response.overflowed);
+    TEST_ASSERT_EQUAL_size_t(RESPONSE_LEN - 1, response.len);
+}
+
+void
+test_overflow_sticks()
+{
+    while (!response.overflowed)
+        counter(&response, "e_total", "Es.", 1);
+
+    size_t len = response.len;
+    TEST_ASSERT_TRUE(len < RESPONSE_LEN);
+
+    // Nothing more goes in, even if it would fit
+    append(&response, "f");
+    TEST_ASSERT_EQUAL_size_t(len, response.len);
+
+    clear(&response);
+    append(&response, "f");
+    TEST_ASSERT_FALSE(response.overflowed);
+    TEST_ASSERT_EQUAL_STRING("f", response.text);
+}
+
+void
+test_is_scrape()
+{
+    auto scrape = [](const char* request) { return is_scrape(request, strlen(request)); };
+
+    TEST_ASSERT_TRUE(scrape("GET /metrics HTTP/1.1\r\n"));
+    TEST_ASSERT_TRUE(scrape("GET /metrics?name[]=a HTTP/1.1\r\n"));
+
+    TEST_ASSERT_FALSE(scrape("GET /metricsx HTTP/1.1\r\n"));
+    TEST_ASSERT_FALSE(scrape("GET / HTTP/1.1\r\n"));
+    TEST_ASSERT_FALSE(scrape("POST /metrics HTTP/1.1\r\n"));
+    TEST_ASSERT_FALSE(scrape("GET /metrics"));
+}
+
+int
+main()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_counters_and_gauges);
+    RUN_TEST(test_histogram_is_cumulative);
+    RUN_TEST(test_fills_to_the_last_byte);
+    RUN_TEST(test_overflow_sticks);
+    RUN_TEST(test_is_scrape);
+
+    return UNITY_END();
+}
@@ -0,0 +1,343 @@
+#include "ota_session.hpp"
+
+#include <unity.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+using namespace ota;
+
+namespace {
+
+/**
+ * Keeps the image in memory. The "hash" is the bytes XORed into 32 lanes, which
+ * is all the session needs to tell images apart.
+ */
+class memory_writer : public flash_writer_t {
+public:
+    size_t
+    capacity() override
+    {
+        return capacity_;
+    }
+
+    const char*
+    begin(size_t) override
+    {
+        image.clear();
+        ++begun;
+        return nullptr;
+    }
+
+    const char*
+    write(const uint8_t* data, size_t len) override
+    {
+        if (fail_writes)
+            return "ESP_ERR_FLASH_OP_FAIL";
+
+        image.insert(image.end(), data, data + len);
+        return nullptr;
+    }
+
+    void
+    digest(uint8_t* sha) override
+    {
+        fake_sha(image.data(), image.size(), sha);
+    }
+
+    const char*
+    commit() override
+    {
+        ++committed;
+        return nullptr;
+    }
+
+    void
+    abort() override
+    {
+        ++aborted;
+    }
+
+    static void
+    fake_sha(const uint8_t* data, size_t len, uint8_t* sha)
+    {
+        memset(sha, 0, SHA256_LEN);
+        for (size_t i = 0; i < len; ++i)
+            sha[i % SHA256_LEN] ^= static_cast<uint8_t>(data[i] + i);
+    }
+
+    size_t capacity_ = 4096;
+    bool fail_writes = false;
+
+    std::vector<uint8_t> image;
+    int begun = 0;
+    int committed = 0;
+    int aborted = 0;
+};
+
+constexpr size_t CHUNK_LEN = 100;
+constexpr size_t IMAGE_LEN = 250; // three chunks, the last one short
+
+memory_writer writer;
+session_t session;
+
+uint8_t image[IMAGE_LEN];
+uint8_t image_sha[SHA256_LEN];
+
+event_t
+send_chunk(uint32_t seq, const uint8_t* data = image, size_t len = 0)
+{
+    size_t offset = seq * CHUNK_LEN;
+    if (!len)
+        len = std::min(CHUNK_LEN, IMAGE_LEN - offset);
+
+    uint8_t payload[SEQ_LEN + CHUNK_LEN + 16];
+    payload[0] = seq & 0xff;
+    payload[1] = (seq >> 8) & 0xff;
+    payload[2] = (seq >> 16) & 0xff;
+    payload[3] = seq >> 24;
+    memcpy(payload + SEQ_LEN, data + offset, len);
+
+    return chunk(&session, payload, SEQ_LEN + len);
+}
+
+} // namespace
+
+void
+setUp()
+{
+    writer = memory_writer{};
+    session = session_t{&writer, STATE_IDLE, 0, {}, 0, 0, nullptr};
+
+    for (size_t i = 0; i < IMAGE_LEN; ++i)
+        image[i] = static_cast<uint8_t>(i * 7);
+    memory_writer::fake_sha(image, IMAGE_LEN, image_sha);
+}
+
+void
+tearDown()
+{}
+
+void
+test_parse_begin()
+{
+    const char* args = "250 "
+                       "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f "
+                       "FFFEFDFCFBFAF9F8F7F6F5F4F3F2F1F0EFEEEDECEBEAE9E8E7E6E5E4E3E2E1E0";
+    size_t size;
+    uint8_t sha[SHA256_LEN];
+    uint8_t mac[SHA256_LEN];
+
+    TEST_ASSERT_TRUE(parse_begin(args, &size, sha, mac));
+    TEST_ASSERT_EQUAL_size_t(250, size);
+    TEST_ASSERT_EQUAL_UINT8(0x00, sha[0]);
+    TEST_ASSERT_EQUAL_UINT8(0x1f, sha[31]);
+    TEST_ASSERT_EQUAL_UINT8(0xff, mac[0]);
+    TEST_ASSERT_EQUAL_UINT8(0xe0, mac[31]);
+}
+
+void
+test_parse_begin_rejects()
+{
+    size_t size;
+    uint8_t sha[SHA256_LEN];
+    uint8_t mac[SHA256_LEN];
+
+    const char* sha_hex = "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f";
+    char args[160];
+
+    // No MAC, as the old protocol sent
+    snprintf(args, sizeof(args), "250 %s", sha_hex);
+    TEST_ASSERT_FALSE(parse_begin(args, &size, sha, mac));
+
+    // Short MAC
+    snprintf(args, sizeof(args), "250 %s %.62s", sha_hex, sha_hex);
+    TEST_ASSERT_FALSE(parse_begin(args, &size, sha, mac));
+
+    // Trailing junk
+    snprintf(args, sizeof(args), "250 %s %s0", sha_hex, sha_hex);
+    TEST_ASSERT_FALSE(parse_begin(args, &size, sha, mac));
+
+    // Not hex
+    snprintf(args, sizeof(args), "250 %s -%.63s", sha_hex, sha_hex);
+    TEST_ASSERT_FALSE(parse_begin(args, &size, sha, mac));
+
+    // No size
+    snprintf(args, sizeof(args), "0 %s %s", sha_hex, sha_hex);
+    TEST_ASSERT_FALSE(parse_begin(args, &size, sha, mac));
+}
+
+void
+test_in_order()
+{
+    TEST_ASSERT_EQUAL(EVENT_STARTED, begin(&session, IMAGE_LEN, image_sha));
+    TEST_ASSERT_EQUAL(EVENT_ACK, send_chunk(0));
+    TEST_ASSERT_EQUAL(EVENT_ACK, send_chunk(1));
+    TEST_ASSERT_EQUAL(EVENT_DONE, send_chunk(2));
+
+    TEST_ASSERT_EQUAL(STATE_DONE, session.state);
+    TEST_ASSERT_EQUAL(1, writer.committed);
+    TEST_ASSERT_EQUAL(0, writer.aborted);
+    TEST_ASSERT_EQUAL_MEMORY(image, writer.image.data(), IMAGE_LEN);
+}
+
+void
+test_out_of_order()
+{
+    begin(&session, IMAGE_LEN, image_sha);
+    send_chunk(0);
+
+    // A chunk from the future isn't written, the sender is told where we are
+    TEST_ASSERT_EQUAL(EVENT_REWIND, send_chunk(2));
+    TEST_ASSERT_EQUAL_UINT32(1, session.next_seq);
+    TEST_ASSERT_EQUAL_size_t(CHUNK_LEN, session.bytes_written);
+
+    TEST_ASSERT_EQUAL(EVENT_ACK, send_chunk(1));
+    TEST_ASSERT_EQUAL(EVENT_DONE, send_chunk(2));
+    TEST_ASSERT_EQUAL_MEMORY(image, writer.image.data(), IMAGE_LEN);
+}
+
+void
+test_duplicate_chunk()
+{
+    begin(&session, IMAGE_LEN, image_sha);
+    send_chunk(0);
+    send_chunk(1);
+
+    // A resent chunk, say its ack got lost
+    TEST_ASSERT_EQUAL(EVENT_REWIND, send_chunk(1));
+    TEST_ASSERT_EQUAL(EVENT_REWIND, send_chunk(0));
+    TEST_ASSERT_EQUAL_UINT32(2, session.next_seq);
+
+    TEST_ASSERT_EQUAL(EVENT_DONE, send_chunk(2));
+    TEST_ASSERT_EQUAL_size_t(IMAGE_LEN, writer.image.size());
+}
+
+void
+test_resume()
+{
+    begin(&session, IMAGE_LEN, image_sha);
+    send_chunk(0);
+
+    // The sender reconnected and announces the same image
+    TEST_ASSERT_EQUAL(EVENT_RESUMED, begin(&session, IMAGE_LEN, image_sha));
+    TEST_ASSERT_EQUAL_UINT32(1, session.next_seq);
+    TEST_ASSERT_EQUAL(1, writer.begun);
+
+    // A different one starts over
+    uint8_t other_sha[SHA256_LEN] = {};
+    TEST_ASSERT_EQUAL(EVENT_STARTED, begin(&session, IMAGE_LEN, other_sha));
+    TEST_ASSERT_EQUAL_UINT32(0, session.next_seq);
+    TEST_ASSERT_EQUAL(1, writer.aborted);
+}
+
+void
+test_image_too_large()
+{
+    writer.capacity_ = IMAGE_LEN - 1;
+
+    TEST_ASSERT_EQUAL(EVENT_FAILED, begin(&session, IMAGE_LEN, image_sha));
+    TEST_ASSERT_EQUAL(STATE_FAILED, session.state);
+    TEST_ASSERT_EQUAL(0, writer.begun);
+    TEST_ASSERT_EQUAL(0, writer.aborted);
+
+    // Chunks get our position, and aren't written
+    TEST_ASSERT_EQUAL(EVENT_REWIND, send_chunk(0));
+    TEST_ASSERT_EQUAL_size_t(0, writer.image.size());
+}
+
+void
+test_image_longer_than_announced()
+{
+    begin(&session, IMAGE_LEN, image_sha);
+    send_chunk(0);
+    send_chunk(1);
+
+    // The last chunk is full length instead of 50 bytes
+    uint8_t longer[3 * CHUNK_LEN] = {};
+    TEST_ASSERT_EQUAL(EVENT_FAILED, send_chunk(2, longer, CHUNK_LEN));
+    TEST_ASSERT_EQUAL(STATE_FAILED, session.state);
+    TEST_ASSERT_EQUAL(1, writer.aborted);
+    TEST_ASSERT_EQUAL(0, writer.committed);
+    TEST_ASSERT_EQUAL_size_t(2 * CHUNK_LEN, writer.image.size());
+}
+
+void
+test_sha_mismatch()
+{
+    begin(&session, IMAGE_LEN, image_sha);
+    send_chunk(0);
+
+    uint8_t corrupted[IMAGE_LEN];
+    memcpy(corrupted, image, IMAGE_LEN);
+    corrupted[CHUNK_LEN + 3] ^= 0x10;
+
+    send_chunk(1, corrupted);
+    TEST_ASSERT_EQUAL(EVENT_FAILED, send_chunk(2));
+
+    TEST_ASSERT_EQUAL(STATE_FAILED, session.state);
+    TEST_ASSERT_EQUAL(1, writer.aborted);
+    TEST_ASSERT_EQUAL(0, writer.committed);
+}
+
+void
+test_write_error()
+{
+    begin(&session, IMAGE_LEN, image_sha);
+    writer.fail_writes = true;
+
+    TEST_ASSERT_EQUAL(EVENT_FAILED, send_chunk(0));
+    TEST_ASSERT_EQUAL_STRING("ESP_ERR_FLASH_OP_FAIL", session.error);
+    TEST_ASSERT_EQUAL(1, writer.aborted);
+}
+
+void
+test_abort()
+{
+    begin(&session, IMAGE_LEN, image_sha);
+    send_chunk(0);
+
+    TEST_ASSERT_EQUAL(EVENT_FAILED, fail(&session, "Aborted"));
+    TEST_ASSERT_EQUAL(1, writer.aborted);
+
+    // Aborting again has nothing left to abort
+    fail(&session, "Aborted");
+    TEST_ASSERT_EQUAL(1, writer.aborted);
+
+    // The rest of the image is turned away, and a new begin starts over
+    TEST_ASSERT_EQUAL(EVENT_REWIND, send_chunk(1));
+    TEST_ASSERT_EQUAL(EVENT_STARTED, begin(&session, IMAGE_LEN, image_sha));
+    TEST_ASSERT_EQUAL_UINT32(0, session.next_seq);
+}
+
+void
+test_short_chunk()
+{
+    begin(&session, IMAGE_LEN, image_sha);
+
+    uint8_t payload[SEQ_LEN] = {};
+    TEST_ASSERT_EQUAL(EVENT_NONE, chunk(&session, payload, sizeof(payload)));
+    TEST_ASSERT_EQUAL(STATE_RECEIVING, session.state);
+}
+
+int
+main()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_parse_begin);
+    RUN_TEST(test_parse_begin_rejects);
+    RUN_TEST(test_in_order);
+    RUN_TEST(test_out_of_order);
+    RUN_TEST(test_duplicate_chunk);
+    RUN_TEST(test_resume);
+    RUN_TEST(test_image_too_large);
+    RUN_TEST(test_image_longer_than_announced);
+    RUN_TEST(test_sha_mismatch);
+    RUN_TEST(test_write_error);
+    RUN_TEST(test_abort);
+    RUN_TEST(test_short_chunk);
+
+    return UNITY_END();
+}
@@ -0,0 +1,283 @@
+#include "pomodoro_session.hpp"
+
+#include <unity.h>
+
+#include <initializer_list>
+
+using namespace pomodoro;
+
+namespace {
+
+/**
+ * A display: its view of the group and the session it's running.
+ */
+struct display_t {
+    group_t group;
+    session_t running;
+};
+
+display_t a, b, c;
+
+/**
+ * Switch to `mode` and publish it, like a transition or a reset does.
+ */
+session_t
+transition(display_t* display, int8_t mode, time_t deadline)
+{
+    session_t session{next_id(&display->group), mode, deadline, 25 * 60, 0, 0};
+    display->running = session;
+    return session;
+}
+
+/**
+ * A retained session reaching a display, the one that sent it included.
+ */
+void
+deliver(display_t* display, const session_t& session)
+{
+    if (merge(&display->group, session))
+        display->running = session;
+}
+
+void
+deliver_all(const session_t& session)
+{
+    for (display_t* display : {&a, &b, &c})
+        deliver(display, session);
+}
+
+void
+assert_agree()
+{
+    TEST_ASSERT_EQUAL_UINT32(a.running.id.version, b.running.id.version);
+    TEST_ASSERT_EQUAL_UINT32(a.running.id.origin, b.running.id.origin);
+    TEST_ASSERT_EQUAL_UINT32(a.running.id.version, c.running.id.version);
+    TEST_ASSERT_EQUAL_UINT32(a.running.id.origin, c.running.id.origin);
+    TEST_ASSERT_EQUAL(a.running.deadline, b.running.deadline);
+    TEST_ASSERT_EQUAL(a.running.deadline, c.running.deadline);
+}
+
+} // namespace
+
+void
+setUp()
+{
+    a = {{0xa, 0, true, {}, {}, false}, {}};
+    b = {{0xb, 0, true, {}, {}, false}, {}};
+    c = {{0xc, 0, true, {}, {}, false}, {}};
+}
+
+void
+tearDown()
+{}
+
+void
+test_id_order()
+{
+    TEST_ASSERT_TRUE((session_id_t{2, 1} > session_id_t{1, 9}));
+    TEST_ASSERT_TRUE((session_id_t{2, 9} > session_id_t{2, 1}));
+    TEST_ASSERT_FALSE((session_id_t{2, 1} > session_id_t{2, 1}));
+    TEST_ASSERT_FALSE((session_id_t{1, 9} > session_id_t{2, 1}));
+}
+
+void
+test_parse_session()
+{
+    session_t session;
+
+    TEST_ASSERT_TRUE(parse_session("7 3054 1 1700000000 300 4 1700000000123", &session));
+    TEST_ASSERT_EQUAL_UINT32(7, session.id.version);
+    TEST_ASSERT_EQUAL_UINT32(3054, session.id.origin);
+    TEST_ASSERT_EQUAL(1, session.mode);
+    TEST_ASSERT_EQUAL_INT64(1700000000, session.deadline);
+    TEST_ASSERT_EQUAL_UINT32(300, session.period_seconds);
+    TEST_ASSERT_EQUAL_UINT32(4, session.count);
+    TEST_ASSERT_EQUAL_INT64(1700000000123LL, session.sent_ms);
+
+    TEST_ASSERT_FALSE(parse_session("7 3054 3 1700000000 300 4 1700000000123", &session));
+    TEST_ASSERT_FALSE(parse_session("7 3054 1 1700000000 300 4", &session));
+}
+
+void
+test_peek_id()
+{
+    const char* message = "7 3054 1 1700000000 300 4 1700000000123";
+    session_id_t id;
+
+    // The payload isn't null-terminated, so only the first few bytes count
+    TEST_ASSERT_TRUE(peek_id(reinterpret_cast<const uint8_t*>(message), 6, &id));
+    TEST_ASSERT_EQUAL_UINT32(7, id.version);
+    TEST_ASSERT_EQUAL_UINT32(3054, id.origin);
+
+    TEST_ASSERT_FALSE(peek_id(reinterpret_cast<const uint8_t*>(message), 2, &id));
+    TEST_ASSERT_FALSE(peek_id(reinterpret_cast<const uint8_t*>("x 1"), 3, &id));
+    TEST_ASSERT_FALSE(peek_id(reinterpret_cast<const uint8_t*>("4294967296 1"), 12, &id));
+}
+
+void
+test_is_echo()
+{
+    session_t mine = transition(&a, 0, 1000);
+    TEST_ASSERT_TRUE(is_echo(a.group, mine.id));
+    TEST_ASSERT_FALSE(is_echo(b.group, mine.id));
+
+    // After a reboot, our retained session from before is news to us, and the
+    // Lamport clock has to catch up with it
+    group_t rebooted{0xa, 0, true, {}, {}, false};
+    TEST_ASSERT_FALSE(is_echo(rebooted, mine.id));
+
+    merge(&rebooted, mine);
+    TEST_ASSERT_TRUE(next_id(&rebooted) > mine.id);
+}
+
+void
+test_follows_one_writer()
+{
+    session_t first = transition(&a, 0, 1000);
+    deliver_all(first);
+    assert_agree();
+
+    session_t second = transition(&a, 1, 2500);
+    deliver_all(second);
+    assert_agree();
+
+    TEST_ASSERT_EQUAL_UINT32(2, b.group.lamport);
+    TEST_ASSERT_EQUAL_INT64(2500, c.running.deadline);
+}
+
+void
+test_concurrent_start()
+{
+    // a and b start at once, neither having heard of the other
+    session_t from_a = transition(&a, 0, 1000);
+    session_t from_b = transition(&b, 0, 1001);
+    TEST_ASSERT_EQUAL_UINT32(from_a.id.version, from_b.id.version);
+
+    // Each sees the messages in a different order, c only sees a's at first
+    deliver(&a, from_a);
+    deliver(&a, from_b);
+    deliver(&b, from_b);
+    deliver(&b, from_a);
+    deliver(&c, from_a);
+    deliver(&c, from_b);
+
+    // The tie goes to the higher node id
+    assert_agree();
+    TEST_ASSERT_EQUAL_UINT32(0xb, a.running.id.origin);
+    TEST_ASSERT_EQUAL_INT64(1001, a.running.deadline);
+}
+
+void
+test_concurrent_transitions_after_agreeing()
+{
+    deliver_all(transition(&c, 0, 1000));
+
+    // Both a and b see the period end, with the same version
+    session_t from_a = transition(&a, 1, 2000);
+    session_t from_b = transition(&b, 1, 2000);
+
+    deliver_all(from_b);
+    deliver_all(from_a);
+    assert_agree();
+    TEST_ASSERT_EQUAL_UINT32(0xb, c.running.id.origin);
+
+    // Everyone's clock has moved past both
+    for (display_t* display : {&a, &b, &c})
+        TEST_ASSERT_EQUAL_UINT32(2, display->group.lamport);
+}
+
+void
+test_reset_wins()
+{
+    deliver_all(transition(&a, 0, 1000));
+    deliver_all(transition(&b, 1, 2000));
+
+    // c resets, and has seen everything, so its session is newest
+    session_t reset = transition(&c, 0, 1500);
+    TEST_ASSERT_TRUE(reset.id > b.running.id);
+
+    deliver_all(reset);
+    assert_agree();
+    TEST_ASSERT_EQUAL_INT64(1500, a.running.deadline);
+}
+
+void
+test_stale_echo()
+{
+    session_t old = transition(&a, 0, 1000);
+    deliver_all(old);
+
+    session_t current = transition(&b, 1, 2000);
+    deliver_all(current);
+
+    // The broker hands a its own old session again, say after a reconnect
+    deliver(&a, old);
+    deliver(&c, old);
+
+    assert_agree();
+    TEST_ASSERT_EQUAL_INT64(2000, a.running.deadline);
+    TEST_ASSERT_EQUAL_UINT32(2, a.group.lamport);
+    TEST_ASSERT_EQUAL_UINT32(current.id.version, a.group.latest.id.version);
+}
+
+void
+test_own_echo()
+{
+    session_t mine = transition(&a, 0, 1000);
+    deliver(&a, mine);
+
+    // Already running it, nothing to switch to
+    TEST_ASSERT_FALSE(merge(&a.group, mine));
+    TEST_ASSERT_EQUAL_UINT32(1, a.group.lamport);
+}
+
+void
+test_join_catches_up()
+{
+    c.group.enabled = false;
+
+    deliver_all(transition(&a, 0, 1000));
+    deliver_all(transition(&b, 1, 2000));
+
+    // Out of the group, c keeps track but doesn't switch
+    TEST_ASSERT_EQUAL_UINT32(0, c.running.id.version);
+    TEST_ASSERT_EQUAL_UINT32(2, c.group.lamport);
+
+    const session_t* latest = join(&c.group);
+    TEST_ASSERT_TRUE(latest != nullptr);
+    c.running = *latest;
+    assert_agree();
+
+    // And its next transition supersedes the group's
+    session_t next = transition(&c, 0, 3000);
+    TEST_ASSERT_TRUE(next.id > b.running.id);
+}
+
+void
+test_join_empty_group()
+{
+    c.group.enabled = false;
+    TEST_ASSERT_TRUE(join(&c.group) == nullptr);
+    TEST_ASSERT_TRUE(c.group.enabled);
+}
+
+int
+main()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_id_order);
+    RUN_TEST(test_parse_session);
+    RUN_TEST(test_peek_id);
+    RUN_TEST(test_is_echo);
+    RUN_TEST(test_follows_one_writer);
+    RUN_TEST(test_concurrent_start);
+    RUN_TEST(test_concurrent_transitions_after_agreeing);
+    RUN_TEST(test_reset_wins);
+    RUN_TEST(test_stale_echo);
+    RUN_TEST(test_own_echo);
+    RUN_TEST(test_join_catches_up);
+    RUN_TEST(test_join_empty_group);
+
+    return UNITY_END();
+}
@@ -0,0 +1,197 @@
+#include "settings_record.hpp"
+
+#include <unity.h>
+
+using namespace settings;
+
+namespace {
+
+constexpr int8_t MODE_COUNT = 3;
+
+/**
+ * A record with every field in `fields` set to something other than zero.
+ */
+record_t
+make_record(uint8_t fields)
+{
+    record_t record{};
+    record.fields = fields;
+
+    if (fields & FIELD_MODE)
+        record.mode = MODE_COUNT - 1;
+    if (fields & FIELD_COLOR) {
+        record.color[0] = 0xff;
+        record.color[1] = 0x80;
+        record.color[2] = 0x01;
+    }
+    if (fields & FIELD_BRIGHTNESS)
+        record.brightness = 200;
+    if (fields & FIELD_WORK)
+        record.minutes[0] = 25;
+    if (fields & FIELD_SHORT_BREAK)
+        record.minutes[1] = 5;
+    if (fields & FIELD_LONG_BREAK)
+        record.minutes[2] = 255;
+
+    return record;
+}
+
+/**
+ * Encode a record with every field.
+ */
+size_t
+encode_full(uint8_t* buf)
+{
+    return encode(make_record(ALL_FIELDS), buf, MAX_LEN);
+}
+
+} // namespace
+
+void
+setUp()
+{}
+
+void
+tearDown()
+{}
+
+void
+test_round_trip_every_subset()
+{
+    for (uint16_t fields = 0; fields <= ALL_FIELDS; ++fields) {
+        record_t record = make_record(fields);
+        uint8_t buf[MAX_LEN];
+
+        size_t len = encode(record, buf, sizeof(buf));
+        TEST_ASSERT_EQUAL_size_t(record_len(fields), len);
+        TEST_ASSERT_EQUAL_UINT8(VERSION, buf[0]);
+        TEST_ASSERT_EQUAL_UINT8(fields, buf[1]);
+
+        record_t decoded;
+        memset(&decoded, 0xaa, sizeof(decoded));
+
+        TEST_ASSERT_TRUE(decode(buf, len, MODE_COUNT, &decoded));
+        TEST_ASSERT_EQUAL_MEMORY(&record, &decoded, sizeof(record));
+    }
+}
+
+void
+test_field_order()
+{
+    uint8_t buf[MAX_LEN];
+    TEST_ASSERT_EQUAL_size_t(MAX_LEN, encode_full(buf));
+
+    const uint8_t expected[] = {
+        VERSION, ALL_FIELDS, MODE_COUNT - 1, 0xff, 0x80, 0x01, 200, 25, 5, 255,
+    };
+    TEST_ASSERT_EQUAL_MEMORY(expected, buf, sizeof(expected));
+}
+
+void
+test_reset_has_no_body()
+{
+    uint8_t buf[MAX_LEN];
+    TEST_ASSERT_EQUAL_size_t(2, encode(make_record(FIELD_RESET), buf, sizeof(buf)));
+
+    record_t decoded;
+    TEST_ASSERT_TRUE(decode(buf, 2, MODE_COUNT, &decoded));
+    TEST_ASSERT_EQUAL_UINT8(FIELD_RESET, decoded.fields);
+}
+
+void
+test_wrong_version()
+{
+    uint8_t buf[MAX_LEN];
+    size_t len = encode_full(buf);
+
+    record_t decoded = make_record(0);
+
+    buf[0] = VERSION + 1;
+    TEST_ASSERT_FALSE(decode(buf, len, MODE_COUNT, &decoded));
+
+    buf[0] = 0;
+    TEST_ASSERT_FALSE(decode(buf, len, MODE_COUNT, &decoded));
+
+    // Left alone
+    TEST_ASSERT_EQUAL_UINT8(0, decoded.fields);
+}
+
+void
+test_unknown_fields()
+{
+    uint8_t buf[MAX_LEN + 1] = {VERSION, FIELD_RESET | 0x80};
+    record_t decoded;
+
+    TEST_ASSERT_FALSE(decode(buf, 2, MODE_COUNT, &decoded));
+
+    // Whatever length the unknown field might have had
+    for (size_t len = 2; len <= sizeof(buf); ++len)
+        TEST_ASSERT_FALSE(decode(buf, len, MODE_COUNT, &decoded));
+
+    record_t record = make_record(FIELD_WORK);
+    record.fields |= 0x80;
+    TEST_ASSERT_EQUAL_size_t(0, encode(record, buf, sizeof(buf)));
+}
+
+void
+test_wrong_length()
+{
+    uint8_t buf[MAX_LEN + 1];
+    size_t len = encode_full(buf);
+    buf[len] = 0;
+
+    record_t decoded;
+
+    for (size_t short_len = 0; short_len < len; ++short_len)
+        TEST_ASSERT_FALSE(decode(buf, short_len, MODE_COUNT, &decoded));
+
+    TEST_ASSERT_FALSE(decode(buf, len + 1, MODE_COUNT, &decoded));
+    TEST_ASSERT_TRUE(decode(buf, len, MODE_COUNT, &decoded));
+}
+
+void
+test_encode_too_small()
+{
+    uint8_t buf[MAX_LEN];
+    TEST_ASSERT_EQUAL_size_t(0, encode(make_record(ALL_FIELDS), buf, MAX_LEN - 1));
+    TEST_ASSERT_EQUAL_size_t(0, encode(make_record(FIELD_RESET), buf, 1));
+}
+
+void
+test_mode_out_of_range()
+{
+    uint8_t buf[] = {VERSION, FIELD_MODE, 0};
+    record_t decoded;
+
+    for (int8_t mode = 0; mode < MODE_COUNT; ++mode) {
+        buf[2] = mode;
+        TEST_ASSERT_TRUE(decode(buf, sizeof(buf), MODE_COUNT, &decoded));
+        TEST_ASSERT_EQUAL_INT8(mode, decoded.mode);
+    }
+
+    buf[2] = MODE_COUNT;
+    TEST_ASSERT_FALSE(decode(buf, sizeof(buf), MODE_COUNT, &decoded));
+
+    buf[2] = 0xff; // -1, the blank screen isn't a mode
+    TEST_ASSERT_FALSE(decode(buf, sizeof(buf), MODE_COUNT, &decoded));
+
+    buf[2] = 0x80;
+    TEST_ASSERT_FALSE(decode(buf, sizeof(buf), MODE_COUNT, &decoded));
+}
+
+int
+main()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_round_trip_every_subset);
+    RUN_TEST(test_field_order);
+    RUN_TEST(test_reset_has_no_body);
+    RUN_TEST(test_wrong_version);
+    RUN_TEST(test_unknown_fields);
+    RUN_TEST(test_wrong_length);
+    RUN_TEST(test_encode_too_small);
+    RUN_TEST(test_mode_out_of_range);
+
+    return UNITY_END();
+}
@@ -0,0 +1,187 @@
+#include "text_cache.hpp"
+
+#include <unity.h>
+
+#include <cstdio>
+
+using namespace text_layout;
+
+namespace {
+
+constexpr uint16_t STYLE = 1;
+constexpr uint16_t WIDTH = 64;
+
+cache_t cache;
+uint32_t measured; // texts that had to be measured
+
+/**
+ * What `text_layout::measure` does, with every glyph 6 pixels wide.
+ */
+const entry_t&
+measure(const char* text, uint16_t style = STYLE)
+{
+    uint16_t length;
+    uint32_t text_hash = hash(text, &length);
+
+    const entry_t* cached = lookup(&cache, text_hash, length, style, WIDTH);
+    if (cached)
+        return *cached;
+
+    ++measured;
+    return insert(&cache, text_hash, length, style, WIDTH, length * 6, 8);
+}
+
+} // namespace
+
+void
+setUp()
+{
+    cache = {};
+    measured = 0;
+}
+
+void
+tearDown()
+{}
+
+void
+test_miss_then_hit()
+{
+    const entry_t& first = measure("12:34");
+    TEST_ASSERT_EQUAL_UINT32(1, measured);
+    TEST_ASSERT_EQUAL_UINT32(0, cache.counters.hits);
+    TEST_ASSERT_EQUAL_UINT32(1, cache.counters.misses);
+
+    const entry_t& second = measure("12:34");
+    TEST_ASSERT_EQUAL_UINT32(1, measured);
+    TEST_ASSERT_EQUAL_UINT32(1, cache.counters.hits);
+    TEST_ASSERT_EQUAL_UINT32(1, cache.counters.misses);
+
+    TEST_ASSERT_TRUE(&first == &second);
+    TEST_ASSERT_EQUAL(30, second.w);
+    TEST_ASSERT_EQUAL(17, second.cursor_x);
+}
+
+void
+test_key_includes_style()
+{
+    measure("12:34", 1);
+    measure("12:34", 2);
+    TEST_ASSERT_EQUAL_UINT32(2, measured);
+
+    measure("12:34", 1);
+    measure("12:34", 2);
+    TEST_ASSERT_EQUAL_UINT32(2, measured);
+}
+
+void
+test_empty_entries_dont_match()
+{
+    // An empty entry has a zero hash and length, like no string but close
+    lookup(&cache, 0, 0, 0, 0);
+    TEST_ASSERT_EQUAL_UINT32(0, cache.counters.hits);
+}
+
+void
+test_fills_before_evicting()
+{
+    char text[8];
+
+    for (size_t i = 0; i < CAPACITY; ++i) {
+        snprintf(text, sizeof(text), "%zu", i);
+        measure(text);
+    }
+    for (size_t i = 0; i < CAPACITY; ++i) {
+        snprintf(text, sizeof(text), "%zu", i);
+        measure(text);
+    }
+
+    TEST_ASSERT_EQUAL_UINT32(CAPACITY, measured);
+}
+
+void
+test_evicts_least_recently_used()
+{
+    char text[8];
+
+    for (size_t i = 0; i < CAPACITY; ++i) {
+        snprintf(text, sizeof(text), "%zu", i);
+        measure(text);
+    }
+
+    // Everything but "0" gets used again, so "0" goes first
+    for (size_t i = 1; i < CAPACITY; ++i) {
+        snprintf(text, sizeof(text), "%zu", i);
+        measure(text);
+    }
+    measure("new");
+    measured = 0;
+
+    measure("1");
+    measure("new");
+    TEST_ASSERT_EQUAL_UINT32(0, measured);
+
+    measure("0");
+    TEST_ASSERT_EQUAL_UINT32(1, measured);
+}
+
+void
+test_stable_strings_survive_one_offs()
+{
+    // What the pomodoro screen does: the same few strings every frame, and a
+    // countdown that changes every second
+    const char* stable[] = {"WORK", "1/4", "25:00"};
+    char text[8];
+
+    for (int frame = 0; frame < 100; ++frame) {
+        for (const char* s : stable)
+            measure(s);
+
+        snprintf(text, sizeof(text), "%02d:%02d", 24 - frame / 60, 59 - frame % 60);
+        measure(text);
+    }
+
+    // The stable strings are measured once, every countdown string once
+    TEST_ASSERT_EQUAL_UINT32(3 + 100, measured);
+    TEST_ASSERT_EQUAL_UINT32(300 - 3, cache.counters.hits);
+}
+
+void
+test_clock_wrap()
+{
+    measure("a");
+    measure("b");
+
+    cache.clock = UINT32_MAX;
+    measure("a"); // wraps
+    TEST_ASSERT_EQUAL_UINT32(1, cache.clock);
+
+    // Ages start over, and what is used after the wrap outlives what is not
+    for (size_t i = 2; i < CAPACITY; ++i) {
+        char text[8];
+        snprintf(text, sizeof(text), "%zu", i);
+        measure(text);
+    }
+    measure("a");
+    measure("new");
+    measured = 0;
+
+    measure("a");
+    TEST_ASSERT_EQUAL_UINT32(0, measured);
+}
+
+int
+main()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_miss_then_hit);
+    RUN_TEST(test_key_includes_style);
+    RUN_TEST(test_empty_entries_dont_match);
+    RUN_TEST(test_fills_before_evicting);
+    RUN_TEST(test_evicts_least_recently_used);
+    RUN_TEST(test_stable_strings_survive_one_offs);
+    RUN_TEST(test_clock_wrap);
+
+    return UNITY_END();
+}
@@ -0,0 +1,192 @@
+#include "timebase_model.hpp"
+
+#include <unity.h>
+
+using namespace timebase;
+
+namespace {
+
+constexpr int64_t EPOCH_S = 1700000000;
+constexpr int64_t SECOND_US = 1000000;
+constexpr int64_t SYNC_INTERVAL_US = 30 * 60 * SECOND_US;
+constexpr int64_t TICK_US = 10 * 1000; // how often the display looks at the clock
+
+/**
+ * A crystal that runs `ppb` slow, i.e. UTC gains `ppb` on it.
+ */
+struct crystal_t {
+    int64_t ppb;
+
+    /**
+     * Mono time UTC second `time` begins at.
+     */
+    int64_t
+    mono_at(int64_t time) const
+    {
+        int64_t utc_us = (time - EPOCH_S) * SECOND_US;
+        return utc_us - utc_us * ppb / (BILLION + ppb);
+    }
+};
+
+/**
+ * Deterministic noise in [-amplitude, amplitude].
+ */
+int64_t
+jitter(uint32_t* state, int64_t amplitude)
+{
+    *state = *state * 1664525 + 1013904223;
+    return amplitude ? static_cast<int64_t>(*state >> 8) % (2 * amplitude + 1) - amplitude : 0;
+}
+
+struct run_t {
+    int64_t max_jump_us; // largest change of the shown time at a sample
+    int64_t min_tick_us; // smallest advance over one tick
+    int64_t max_tick_us; // largest advance over one tick
+};
+
+/**
+ * Sync every half hour for `hours`, with each sample's timestamp `jitter_us`
+ * off, and watch the clock in between.
+ */
+run_t
+simulate(discipline_t* d, const crystal_t& crystal, int hours, int64_t jitter_us)
+{
+    run_t run{0, INT64_MAX, 0};
+    uint32_t noise = 1;
+
+    apply_sample(d, EPOCH_S, crystal.mono_at(EPOCH_S));
+
+    int64_t mono_us = crystal.mono_at(EPOCH_S);
+    int64_t shown_us = wall_at(d->model, mono_us);
+
+    for (int sync = 1; sync <= hours * 2; ++sync) {
+        int64_t time = EPOCH_S + sync * SYNC_INTERVAL_US / SECOND_US;
+        int64_t sample_us = crystal.mono_at(time) + jitter(&noise, jitter_us);
+
+        for (; mono_us + TICK_US <= sample_us; mono_us += TICK_US) {
+            int64_t next_us = wall_at(d->model, mono_us + TICK_US);
+
+            run.min_tick_us = std::min(run.min_tick_us, next_us - shown_us);
+            run.max_tick_us = std::max(run.max_tick_us, next_us - shown_us);
+            shown_us = next_us;
+        }
+
+        int64_t before_us = wall_at(d->model, sample_us);
+        apply_sample(d, time, sample_us);
+        int64_t after_us = wall_at(d->model, sample_us);
+
+        run.max_jump_us = std::max(run.max_jump_us, std::abs(after_us - before_us));
+
+        // Carry on from the sample, as the display would
+        shown_us += after_us - before_us;
+    }
+
+    return run;
+}
+
+} // namespace
+
+void
+setUp()
+{}
+
+void
+tearDown()
+{}
+
+void
+test_first_sample_steps()
+{
+    discipline_t d{};
+    apply_sample(&d, EPOCH_S, 5 * SECOND_US);
+
+    TEST_ASSERT_TRUE(d.is_set);
+    TEST_ASSERT_EQUAL_UINT32(1, d.steps);
+    TEST_ASSERT_EQUAL_INT64(EPOCH_S * SECOND_US, wall_at(d.model, 5 * SECOND_US));
+    TEST_ASSERT_EQUAL_INT64(EPOCH_S * SECOND_US + 1500, wall_at(d.model, 5 * SECOND_US + 1500));
+}
+
+void
+test_large_offset_steps()
+{
+    discipline_t d{};
+    apply_sample(&d, EPOCH_S, 0);
+    apply_sample(&d, EPOCH_S + 60 + 2, 60 * SECOND_US);
+
+    TEST_ASSERT_EQUAL_UINT32(2, d.steps);
+    TEST_ASSERT_EQUAL_INT64((EPOCH_S + 62) * SECOND_US, wall_at(d.model, 60 * SECOND_US));
+}
+
+void
+test_small_offset_slews()
+{
+    discipline_t d{};
+    apply_sample(&d, EPOCH_S, 0);
+
+    // 100 ms behind
+    int64_t sample_us = 60 * SECOND_US - 100 * 1000;
+    apply_sample(&d, EPOCH_S + 60, sample_us);
+
+    TEST_ASSERT_EQUAL_UINT32(1, d.steps);
+    TEST_ASSERT_EQUAL_INT64(100 * 1000, d.last_offset_us);
+    TEST_ASSERT_EQUAL_INT64(100 * 1000, slew_left_at(d.model, sample_us));
+
+    // Nothing moves at the sample, the offset is gone once the slew is
+    int64_t slew_us = 100 * 1000 * BILLION / SLEW_PPB;
+    TEST_ASSERT_EQUAL_INT64((EPOCH_S + 60) * SECOND_US - 100 * 1000, wall_at(d.model, sample_us));
+    TEST_ASSERT_EQUAL_INT64(
+        (EPOCH_S + 60) * SECOND_US + slew_us, wall_at(d.model, sample_us + slew_us)
+    );
+}
+
+void
+test_drift_never_jumps()
+{
+    discipline_t d{};
+    run_t run = simulate(&d, {30 * 1000}, 24, 0);
+
+    // Changing the drift estimate must not move the time already shown
+    TEST_ASSERT_LESS_OR_EQUAL_INT64(1, run.max_jump_us);
+
+    // Never backwards, never faster than drift plus slew
+    TEST_ASSERT_GREATER_OR_EQUAL_INT64(TICK_US - TICK_US * 2 * SLEW_PPB / BILLION, run.min_tick_us);
+    TEST_ASSERT_LESS_OR_EQUAL_INT64(TICK_US + TICK_US * 2 * SLEW_PPB / BILLION, run.max_tick_us);
+    TEST_ASSERT_EQUAL_UINT32(1, d.steps);
+}
+
+void
+test_drift_converges()
+{
+    discipline_t d{};
+    simulate(&d, {30 * 1000}, 24, 0);
+
+    TEST_ASSERT_INT64_WITHIN(500, 30 * 1000, d.model.drift_ppb);
+    TEST_ASSERT_INT64_WITHIN(1000, 0, d.last_offset_us);
+}
+
+void
+test_jitter_never_jumps()
+{
+    discipline_t d{};
+    run_t run = simulate(&d, {-20 * 1000}, 48, 20 * 1000);
+
+    TEST_ASSERT_LESS_OR_EQUAL_INT64(1, run.max_jump_us);
+    TEST_ASSERT_GREATER_OR_EQUAL_INT64(0, run.min_tick_us);
+    TEST_ASSERT_EQUAL_UINT32(1, d.steps);
+    TEST_ASSERT_INT64_WITHIN(5 * 1000, -20 * 1000, d.model.drift_ppb);
+}
+
+int
+main()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_first_sample_steps);
+    RUN_TEST(test_large_offset_steps);
+    RUN_TEST(test_small_offset_slews);
+    RUN_TEST(test_drift_never_jumps);
+    RUN_TEST(test_drift_converges);
+    RUN_TEST(test_jitter_never_jumps);
+
+    return UNITY_END();
+}